@@ -0,0 +1,574 @@
+// Benchmarks for autoignore's hot paths on generated fixtures.
+//
+//   autoignore_bench [--fixtures DIR] [--sizes N,N,...] [--libraries N,N,...]
+//                    [--runs N] [--filter TEXT] [--out FILE]
+//                    [--baseline FILE] [--threshold PCT]
+//
+// Fixtures (node, rust and python trees of each size, template libraries of
+// each size) are created under DIR once and reused by later runs. Results
+// are printed as JSON; with --baseline, each median is compared against the
+// saved one and the exit status is 1 if any is slower by more than the
+// threshold.
+
+#include "Detector.hpp"
+#include "Generator.hpp"
+#include "SearchIndex.hpp"
+#include "TemplatePack.hpp"
+#include "TemplateStore.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Result {
+    std::string name;
+    int runs = 0;
+    double min_ms = 0;
+    double median_ms = 0;
+    std::uint64_t heap_kb = 0;  // memory results only, which have no times
+};
+
+struct Config {
+    fs::path fixtures = "bench-fixtures";
+    std::vector<std::size_t> sizes = {10000, 100000, 1000000};
+    std::vector<std::size_t> libraries = {0, 1000, 10000};  // synthetic templates on top of the bundled ones
+    int runs = 5;
+    std::string filter;
+    std::string out;
+    std::string baseline;
+    double threshold = 10;  // percent
+};
+
+// ---- Fixtures ---------------------------------------------------------------
+
+// Creates files and directories until `left` runs out.
+class TreeBuilder {
+public:
+    TreeBuilder(const fs::path& root, std::size_t entries) : root(root), left(entries) {}
+
+    bool done() const { return left == 0; }
+
+    bool dir(const std::string& rel) {
+        if (!left) return false;
+        left--;
+        return mkdir((root / rel).c_str(), 0755) == 0 || errno == EEXIST;
+    }
+
+    bool file(const std::string& rel, std::string_view content = {}) {
+        if (!left) return false;
+        left--;
+        int fd = open((root / rel).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return false;
+        if (!content.empty() && write(fd, content.data(), content.size()) < 0) {}
+        close(fd);
+        return true;
+    }
+
+private:
+    fs::path root;
+    std::size_t left;
+};
+
+// A JS monorepo: a few workspaces with sources, most entries in
+// node_modules.
+void make_node(TreeBuilder& t, std::mt19937& rng) {
+    t.file("package.json", R"({"name": "mono", "dependencies": {"react": "^18.2.0"}})");
+    t.file("package-lock.json");
+    t.dir("src");
+    for (int i = 0; i < 40; i++) t.file("src/component" + std::to_string(i) + ".tsx");
+    t.dir("packages");
+    for (int p = 0; p < 8 && !t.done(); p++) {
+        auto base = "packages/pkg" + std::to_string(p);
+        t.dir(base);
+        t.file(base + "/package.json", "{}");
+        t.dir(base + "/src");
+        for (int i = 0; i < 30; i++) t.file(base + "/src/mod" + std::to_string(i) + ".ts");
+        t.dir(base + "/dist");
+        for (int i = 0; i < 30; i++) t.file(base + "/dist/mod" + std::to_string(i) + ".js");
+    }
+    t.dir("node_modules");
+    for (int m = 0; !t.done(); m++) {
+        auto base = "node_modules/dep" + std::to_string(m);
+        t.dir(base);
+        t.file(base + "/package.json", "{}");
+        t.file(base + "/index.js");
+        t.file(base + "/README.md");
+        t.dir(base + "/lib");
+        int files = 5 + int(rng() % 40);
+        for (int i = 0; i < files; i++) t.file(base + "/lib/f" + std::to_string(i) + ".js");
+        if (rng() % 4 == 0) {
+            t.dir(base + "/node_modules");
+            for (int n = 0; n < 3; n++) {
+                auto nested = base + "/node_modules/sub" + std::to_string(n);
+                t.dir(nested);
+                t.file(nested + "/package.json", "{}");
+                for (int i = 0; i < 8; i++) t.file(nested + "/f" + std::to_string(i) + ".js");
+            }
+        }
+    }
+}
+
+// A cargo workspace: crates with sources, most entries under target/.
+void make_rust(TreeBuilder& t, std::mt19937& rng) {
+    t.file("Cargo.toml", "[workspace]\n");
+    t.file("Cargo.lock");
+    t.dir("crates");
+    for (int c = 0; c < 12; c++) {
+        auto base = "crates/crate" + std::to_string(c);
+        t.dir(base);
+        t.file(base + "/Cargo.toml");
+        t.dir(base + "/src");
+        for (int i = 0; i < 25; i++) t.file(base + "/src/m" + std::to_string(i) + ".rs");
+    }
+    t.dir("target");
+    t.dir("target/debug");
+    t.dir("target/debug/deps");
+    t.dir("target/debug/build");
+    t.dir("target/debug/incremental");
+    for (int d = 0; !t.done(); d++) {
+        auto hash = std::to_string(rng() % 100000000);
+        auto name = "dep" + std::to_string(d) + "-" + hash;
+        t.file("target/debug/deps/lib" + name + ".rlib");
+        t.file("target/debug/deps/" + name + ".d");
+        auto inc = "target/debug/incremental/" + name;
+        t.dir(inc);
+        t.dir(inc + "/s-" + hash);
+        int objects = 10 + int(rng() % 60);
+        for (int i = 0; i < objects; i++) t.file(inc + "/s-" + hash + "/cgu" + std::to_string(i) + ".o");
+        if (d % 5 == 0) {
+            auto build = "target/debug/build/" + name;
+            t.dir(build);
+            t.dir(build + "/out");
+            for (int i = 0; i < 6; i++) t.file(build + "/out/gen" + std::to_string(i) + ".rs");
+        }
+    }
+}
+
+// A Python project with a virtualenv holding most entries.
+void make_python(TreeBuilder& t, std::mt19937& rng) {
+    t.file("pyproject.toml", "[tool.poetry]\nname = \"app\"\n");
+    t.file("requirements.txt", "Django>=4.2\n");
+    t.file("manage.py");
+    t.dir("app");
+    for (int m = 0; m < 20; m++) {
+        auto base = "app/mod" + std::to_string(m);
+        t.dir(base);
+        t.file(base + "/__init__.py");
+        t.dir(base + "/__pycache__");
+        for (int i = 0; i < 10; i++) {
+            t.file(base + "/f" + std::to_string(i) + ".py");
+            t.file(base + "/__pycache__/f" + std::to_string(i) + ".cpython-312.pyc");
+        }
+    }
+    t.dir("tests");
+    for (int i = 0; i < 40; i++) t.file("tests/test_" + std::to_string(i) + ".py");
+    t.dir("venv");
+    t.dir("venv/lib");
+    t.dir("venv/lib/python3.12");
+    t.dir("venv/lib/python3.12/site-packages");
+    for (int p = 0; !t.done(); p++) {
+        auto base = "venv/lib/python3.12/site-packages/pkg" + std::to_string(p);
+        t.dir(base);
+        t.dir(base + "/__pycache__");
+        int files = 5 + int(rng() % 50);
+        for (int i = 0; i < files; i++) {
+            t.file(base + "/m" + std::to_string(i) + ".py");
+            t.file(base + "/__pycache__/m" + std::to_string(i) + ".cpython-312.pyc");
+        }
+    }
+}
+
+const std::vector<std::pair<std::string, void (*)(TreeBuilder&, std::mt19937&)>> layouts = {
+    {"node", make_node},
+    {"rust", make_rust},
+    {"python", make_python},
+};
+
+// Fixtures are complete once their stamp file exists.
+bool ready(const fs::path& dir) { return fs::exists(dir / ".complete"); }
+
+void mark_ready(const fs::path& dir) { std::ofstream(dir / ".complete"); }
+
+fs::path tree_fixture(const Config& cfg, const std::string& layout,
+                      void (*make)(TreeBuilder&, std::mt19937&), std::size_t entries)
+{
+    auto dir = cfg.fixtures / ("tree-" + layout + "-" + std::to_string(entries));
+    if (ready(dir)) return dir;
+    std::cerr << "creating " << dir.native() << "\n";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    TreeBuilder t(dir, entries);
+    std::mt19937 rng(42);
+    make(t, rng);
+    mark_ready(dir);
+    return dir;
+}
+
+// A home directory with `count` synthetic templates in the user template
+// directory, on top of the bundled ones.
+fs::path library_fixture(const Config& cfg, std::size_t count) {
+    auto home = cfg.fixtures / ("library-" + std::to_string(count));
+    if (ready(home)) return home;
+    std::cerr << "creating " << home.native() << "\n";
+    fs::remove_all(home);
+    auto dir = home / ".local/share/autoignore/template";
+    fs::create_directories(dir);
+    std::mt19937 rng(7);
+    for (std::size_t i = 0; i < count; i++) {
+        auto name = "synthetic" + std::to_string(i);
+        std::ostringstream body;
+        body << "# " << name << "\n# @detect: *.syn" << i << " " << name << ".toml\n";
+        if (i % 10 == 0) body << "# @content: package.json \"" << name << "\"\n";
+        body << "\n";
+        int lines = 10 + int(rng() % 60);
+        for (int l = 0; l < lines; l++) {
+            switch (rng() % 4) {
+                case 0: body << "*.ext" << rng() % 500 << "\n"; break;
+                case 1: body << "build" << rng() % 50 << "/\n"; break;
+                case 2: body << "!keep" << rng() % 20 << ".txt\n"; break;
+                default: body << "# comment " << l << "\n"; break;
+            }
+        }
+        std::ofstream(dir / (name + ".gitignore")) << body.str();
+    }
+    mark_ready(home);
+    return home;
+}
+
+// Points TemplateStore at a fixture home with its own index cache.
+void use_home(const fs::path& home) {
+    setenv("HOME", fs::absolute(home).c_str(), 1);
+    setenv("XDG_CACHE_HOME", fs::absolute(home / ".cache").c_str(), 1);
+}
+
+// ---- Measurement ------------------------------------------------------------
+
+class Bench {
+public:
+    explicit Bench(const Config& cfg) : cfg(cfg) {}
+
+    // Times `fn` cfg.runs times, after `setup` each time (untimed).
+    void run(const std::string& name, const std::function<void()>& fn,
+             const std::function<void()>& setup = {})
+    {
+        if (!cfg.filter.empty() && name.find(cfg.filter) == std::string::npos) return;
+        std::vector<double> ms;
+        for (int i = 0; i < cfg.runs; i++) {
+            if (setup) setup();
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::sort(ms.begin(), ms.end());
+        results.push_back({name, cfg.runs, ms.front(), ms[ms.size() / 2]});
+        std::cerr << "  " << name << ": " << ms[ms.size() / 2] << " ms\n";
+    }
+
+    // Records the heap that `build` leaves allocated in what it returns.
+    template <typename F>
+    void heap(const std::string& name, F&& build) {
+        if (!cfg.filter.empty() && name.find(cfg.filter) == std::string::npos) return;
+        auto before = mallinfo2().uordblks;
+        auto kept = build();
+        auto kb = (mallinfo2().uordblks - before) / 1024;
+        results.push_back({name, 1, 0, 0, kb});
+        std::cerr << "  " << name << ": " << kb << " KiB\n";
+    }
+
+    // A benchmark whose output was wrong; fails the run.
+    void fail(const std::string& name, const std::string& why) {
+        failures++;
+        std::cerr << "  " << name << ": FAILED: " << why << "\n";
+    }
+
+    const std::vector<Result>& all() const { return results; }
+    int failed() const { return failures; }
+
+private:
+    const Config& cfg;
+    std::vector<Result> results;
+    int failures = 0;
+};
+
+void bench_library(Bench& bench, const Config& cfg, std::size_t count) {
+    auto home = library_fixture(cfg, count);
+    use_home(home);
+    auto label = "library/" + std::to_string(count);
+    auto index = home / ".cache/autoignore/index.bin";
+
+    bench.run(label + "/all-cold", [] { TemplateStore().all(); }, [&] { fs::remove(index); });
+    bench.run(label + "/all-warm", [] { TemplateStore().all(); });
+    // What `autoignore python synthetic1` costs before generating: should
+    // not grow with the library.
+    bench.run(label + "/find-direct", [] {
+        TemplateStore s;
+        s.find("python");
+        s.find("synthetic1");
+    });
+
+    // The catalogue as held in memory, and with the detection matcher.
+    bench.heap(label + "/all-heap", [] {
+        auto s = std::make_unique<TemplateStore>();
+        s->all();
+        return s;
+    });
+    bench.heap(label + "/detector-heap", [] {
+        auto s = std::make_unique<TemplateStore>();
+        auto d = std::make_unique<Detector>(*s);
+        return std::make_pair(std::move(s), std::move(d));
+    });
+
+    TemplateStore store;
+    std::vector<std::string> names;
+    for (const auto& t : store.all()) names.emplace_back(t.name);
+
+    bench.run(label + "/detector-build", [&] { Detector d(store); });
+    bench.run(label + "/find", [&] {
+        for (const auto& n : names) store.find(n);
+    });
+    bench.run(label + "/search", [&] {
+        for (const char* q : {"py", "rust", "nodjs", "synthetic12", "visual", "x"}) store.search(q);
+    });
+    // What the interactive filter does while "synthetic42" is typed and
+    // then erased again.
+    bench.run(label + "/filter-typing", [&] {
+        SearchIndex search(names);
+        std::string q = "synthetic42";
+        for (std::size_t i = 1; i <= q.size(); i++) search.query(std::string_view(q).substr(0, i));
+        for (std::size_t i = q.size(); i-- > 0;) search.query(std::string_view(q).substr(0, i));
+    });
+    bench.run(label + "/names", [&] { store.names("syn"); });
+
+    // The same templates as one pack on AUTOIGNORE_PATH, over a home
+    // without a user template directory.
+    auto pack = home / "library.pack";
+    if (!fs::exists(pack)) {
+        std::vector<TemplatePack::Source> sources;
+        for (const auto& t : store.all()) {
+            if (t.path.empty()) continue;
+            TemplatePack::Source s;
+            s.name = t.name;
+            s.body = store.read_content(t);
+            for (auto id : t.detect_patterns) s.detect_patterns.emplace_back(store.strings()[id]);
+            for (auto id : t.content_rules) s.content_rules.emplace_back(store.strings()[id]);
+            s.hash = t.hash;
+            sources.push_back(std::move(s));
+        }
+        TemplatePack::write(pack, std::move(sources), false);
+    }
+    use_home(library_fixture(cfg, 0));
+    setenv("AUTOIGNORE_PATH", fs::absolute(pack).c_str(), 1);
+    bench.run(label + "/pack-all", [] { TemplateStore().all(); });
+    bench.run(label + "/pack-names", [] { TemplateStore().names("syn"); });
+    unsetenv("AUTOIGNORE_PATH");
+}
+
+void bench_generate(Bench& bench, const Config& cfg) {
+    use_home(library_fixture(cfg, 0));
+    TemplateStore store;
+    Generator gen(store);
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    std::vector<std::string> few = {"python", "nodejs", "react", "vscode", "linux"};
+    std::vector<std::string> many;
+    for (const auto& t : store.all()) many.emplace_back(t.name);
+    auto out = cfg.fixtures / "generated.gitignore";
+
+    for (bool merge : {false, true}) {
+        GenerateOptions opts;
+        opts.merge = merge;
+        opts.preview = true;
+        opts.preview_fd = null_fd;
+        auto suffix = merge ? "-merge" : "";
+        bench.run(std::string("generate/5") + suffix, [&] { gen.generate(few, opts); });
+        bench.run(std::string("generate/all") + suffix, [&] { gen.generate(many, opts); });
+        opts.preview = false;
+        opts.output = out;
+        bench.run(std::string("generate/5-file") + suffix, [&] { gen.generate(few, opts); });
+    }
+    close(null_fd);
+}
+
+// --update of a merged file after a template lost a pattern that a later
+// one also ships: the later section has to be merged again to get it back.
+void bench_update(Bench& bench, const Config& cfg) {
+    auto dir = cfg.fixtures / "update";
+    fs::create_directories(dir / "templates");
+    auto write = [](const fs::path& file, std::string_view text) { std::ofstream(file) << text; };
+    write(dir / "templates/bbb.gitignore", "foo/\n*.tmp\n");
+    setenv("AUTOIGNORE_PATH", fs::absolute(dir / "templates").c_str(), 1);
+    auto out = dir / "merged.gitignore";
+    std::string name = "update/merge";
+    fs::remove(out);
+
+    bench.run(name, [&] {
+        TemplateStore store;
+        Generator(store).update(out);
+    }, [&] {
+        write(dir / "templates/aaa.gitignore", "*.log\nfoo/\n");
+        TemplateStore store;
+        GenerateOptions opts;
+        opts.merge = true;
+        opts.output = out;
+        Generator(store).generate({"aaa", "bbb"}, opts);
+        write(dir / "templates/aaa.gitignore", "*.log\n");
+    });
+    unsetenv("AUTOIGNORE_PATH");
+
+    if (!fs::exists(out)) return;  // filtered out
+    std::ifstream in(out);
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (text.find("\nfoo/\n") == std::string::npos) bench.fail(name, "foo/ lost from bbb's section");
+}
+
+void bench_detect(Bench& bench, const Config& cfg) {
+    use_home(library_fixture(cfg, 0));
+    TemplateStore store;
+    DetectOptions pruned;
+    DetectOptions full;
+    full.prune_defaults = false;
+    full.gitignore = false;
+    Detector detector(store);
+
+    for (auto size : cfg.sizes) {
+        for (const auto& [layout, make] : layouts) {
+            auto root = tree_fixture(cfg, layout, make, size);
+            auto label = "detect/" + layout + "/" + std::to_string(size);
+            bench.run(label, [&] { detector.detect(root, pruned); });
+            bench.run(label + "/full-walk", [&] { detector.detect(root, full); });
+        }
+    }
+}
+
+// ---- Output -----------------------------------------------------------------
+
+std::string to_json(const std::vector<Result>& results) {
+    std::ostringstream out;
+    out << "{\n  \"benchmarks\": [\n";
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"runs\": " << r.runs
+            << ", \"min_ms\": " << r.min_ms << ", \"median_ms\": " << r.median_ms;
+        if (r.heap_kb) out << ", \"heap_kb\": " << r.heap_kb;
+        out << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
+
+// Reads back what to_json() wrote: one benchmark per line.
+std::vector<Result> from_json(const std::string& path) {
+    std::vector<Result> results;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        auto name = line.find("\"name\": \"");
+        auto median = line.find("\"median_ms\": ");
+        if (name == std::string::npos || median == std::string::npos) continue;
+        name += 9;
+        Result r;
+        r.name = line.substr(name, line.find('"', name) - name);
+        r.median_ms = std::strtod(line.c_str() + median + 13, nullptr);
+        results.push_back(std::move(r));
+    }
+    return results;
+}
+
+// Prints each benchmark against the baseline; returns the number of
+// regressions beyond the threshold. Sub-0.05 ms differences are noise.
+int compare(const std::vector<Result>& now, const std::vector<Result>& base, double threshold) {
+    int regressions = 0;
+    std::fprintf(stderr, "%-40s %13s %13s %8s\n", "benchmark", "baseline", "now", "change");
+    for (const auto& r : now) {
+        auto it = std::find_if(base.begin(), base.end(), [&](const Result& b) { return b.name == r.name; });
+        if (it == base.end() || it->median_ms <= 0) continue;
+        double change = (r.median_ms / it->median_ms - 1) * 100;
+        bool regressed = change > threshold && r.median_ms - it->median_ms > 0.05;
+        regressions += regressed;
+        std::fprintf(stderr, "%-40s %10.3f ms %10.3f ms %+7.1f%%%s\n", r.name.c_str(), it->median_ms,
+                     r.median_ms, change, regressed ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+std::vector<std::size_t> parse_list(const char* s) {
+    std::vector<std::size_t> out;
+    for (std::string_view v = s; !v.empty();) {
+        auto comma = v.find(',');
+        out.push_back(std::strtoull(std::string(v.substr(0, comma)).c_str(), nullptr, 10));
+        v = comma == std::string_view::npos ? std::string_view{} : v.substr(comma + 1);
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Config cfg;
+    for (int i = 1; i < argc; i++) {
+        std::string_view a = argv[i];
+        bool has_value = i + 1 < argc;
+        if (a == "--fixtures" && has_value) cfg.fixtures = argv[++i];
+        else if (a == "--sizes" && has_value) cfg.sizes = parse_list(argv[++i]);
+        else if (a == "--libraries" && has_value) cfg.libraries = parse_list(argv[++i]);
+        else if (a == "--runs" && has_value) cfg.runs = std::max(1, std::atoi(argv[++i]));
+        else if (a == "--filter" && has_value) cfg.filter = argv[++i];
+        else if (a == "--out" && has_value) cfg.out = argv[++i];
+        else if (a == "--baseline" && has_value) cfg.baseline = argv[++i];
+        else if (a == "--threshold" && has_value) cfg.threshold = std::strtod(argv[++i], nullptr);
+        else {
+            std::cerr << "usage: " << argv[0] << " [--fixtures DIR] [--sizes N,...] [--libraries N,...]"
+                      << " [--runs N] [--filter TEXT] [--out FILE] [--baseline FILE] [--threshold PCT]\n";
+            return 2;
+        }
+    }
+    fs::create_directories(cfg.fixtures);
+    unsetenv("AUTOIGNORE_SOCKET");
+
+    Bench bench(cfg);
+    for (auto count : cfg.libraries) bench_library(bench, cfg, count);
+    bench_generate(bench, cfg);
+    bench_update(bench, cfg);
+    bench_detect(bench, cfg);
+
+    auto json = to_json(bench.all());
+    if (cfg.out.empty()) std::cout << json;
+    else std::ofstream(cfg.out) << json;
+
+    if (bench.failed()) return 1;
+    if (!cfg.baseline.empty()) {
+        auto base = from_json(cfg.baseline);
+        if (base.empty()) {
+            std::cerr << "cannot read baseline " << cfg.baseline << "\n";
+            return 2;
+        }
+        int regressions = compare(bench.all(), base, cfg.threshold);
+        if (regressions) {
+            std::cerr << regressions << " benchmark(s) slower than the baseline by more than "
+                      << cfg.threshold << "%\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -3,11 +3,11 @@ _autoignore() {
     _init_completion || return
 
     case "$prev" in
-        -o|--output)
+        -o|--output|--batch|--stats-json|--trace)
             _filedir
             return
             ;;
-        -s|--search)
+        -s|--search|-j|--jobs|--prune|--max-entries|--time-budget)
             return
             ;;
     esac
@@ -15,14 +15,16 @@ _autoignore() {
     if [[ "$cur" == -* ]]; then
         COMPREPLY=($(compgen -W \
             '-l --list -s --search -i --interactive -d --detect
-             -o --output -a --append -p --preview -v --verbose -h --help' \
+             -o --output -a --append -p --preview -m --merge -j --jobs --batch
+             --prune --no-prune --max-entries --time-budget --check --update --watch --stats-json --trace -v --verbose -h --help' \
             -- "$cur"))
         return
     fi
 
-    local templates
-    templates=$(autoignore --list 2>/dev/null | awk '/^  [a-z]/{print $1}')
-    COMPREPLY=($(compgen -W "$templates" -- "$cur"))
+    local IFS=$'\n'
+    COMPREPLY=($(autoignore complete -- "$cur" 2>/dev/null))
+    [[ $COMP_CWORD -eq 1 ]] &&
+        COMPREPLY+=($(compgen -W $'info\nstats\nmix\nsuggest\ncheck-ignore\ncoverage\npack\nserve' -- "$cur"))
 }
 
 complete -F _autoignore autoignore
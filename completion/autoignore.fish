@@ -1,5 +1,5 @@
 function __autoignore_templates
-    autoignore --list 2>/dev/null | awk '/^  [a-z]/{print $1}'
+    autoignore complete -- (commandline -ct) 2>/dev/null
 end
 
 complete -c autoignore -s l -l list        -d 'List available templates'
@@ -7,8 +7,28 @@ complete -c autoignore -s s -l search      -d 'Search templates by name' -r
 complete -c autoignore -s i -l interactive -d 'Select templates interactively'
 complete -c autoignore -s d -l detect      -d 'Auto-detect templates from project files'
 complete -c autoignore -s o -l output      -d 'Output file' -r -F
-complete -c autoignore -s a -l append      -d 'Append to existing file'
+complete -c autoignore -s a -l append      -d 'Add only what the existing file lacks'
 complete -c autoignore -s p -l preview     -d 'Preview output without writing'
+complete -c autoignore -s m -l merge       -d 'Write each pattern once'
+complete -c autoignore -s j -l jobs        -d 'Threads used by --detect' -x
+complete -c autoignore -l batch            -d 'Detect and generate for each listed root' -r -F
+complete -c autoignore -l prune            -d 'Directories --detect does not descend into' -x
+complete -c autoignore -l no-prune         -d 'Descend everywhere in --detect'
+complete -c autoignore -l max-entries      -d 'Stop --detect after visiting n entries' -x
+complete -c autoignore -l time-budget      -d 'Stop --detect after ms milliseconds' -x
+complete -c autoignore -l check            -d 'Exit 1 if the output file is stale'
+complete -c autoignore -l update           -d 'Re-render the changed sections of the output file'
+complete -c autoignore -l watch            -d 'Keep the output in step with the tree'
+complete -c autoignore -l stats-json       -d 'Write phase timings and counters as JSON' -r -F
+complete -c autoignore -l trace            -d 'Write phase timings as a Chrome trace' -r -F
 complete -c autoignore -s v -l verbose     -d 'Verbose output'
 complete -c autoignore -s h -l help        -d 'Show help'
 complete -c autoignore -f -a '(__autoignore_templates)'
+complete -c autoignore -f -n '__fish_use_subcommand' -a info    -d 'List templates with descriptions'
+complete -c autoignore -f -n '__fish_use_subcommand' -a stats   -d 'Show catalogue statistics'
+complete -c autoignore -f -n '__fish_use_subcommand' -a mix     -d 'Analyse a combination of templates'
+complete -c autoignore -f -n '__fish_use_subcommand' -a suggest -d 'Suggest templates for a project name'
+complete -c autoignore -f -n '__fish_use_subcommand' -a check-ignore -d 'Print the paths from stdin that would be ignored'
+complete -c autoignore -f -n '__fish_use_subcommand' -a coverage -d 'Report what each pattern matches in this tree'
+complete -c autoignore -f -n '__fish_use_subcommand' -a pack    -d 'Build a template pack'
+complete -c autoignore -f -n '__fish_use_subcommand' -a serve   -d 'Keep templates loaded for other invocations'
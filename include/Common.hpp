@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 namespace color {
     const std::string reset   = "\033[0m";
@@ -8,7 +9,39 @@ namespace color {
     const std::string red     = "\033[31m";
     const std::string green   = "\033[32m";
     const std::string yellow  = "\033[33m";
+    const std::string blue    = "\033[34m";
+    const std::string magenta = "\033[35m";
     const std::string cyan    = "\033[36m";
     const std::string white   = "\033[37m";
     const std::string gray    = "\033[90m";
 }
+
+namespace json {
+    // Returns s as a quoted JSON string literal.
+    inline std::string quote(std::string_view s) {
+        static const char hex[] = "0123456789abcdef";
+        std::string out;
+        out.reserve(s.size() + 2);
+        out += '"';
+        for (char ch : s) {
+            auto c = static_cast<unsigned char>(ch);
+            switch (c) {
+                case '"':  out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n";  break;
+                case '\r': out += "\\r";  break;
+                case '\t': out += "\\t";  break;
+                default:
+                    if (c < 0x20) {
+                        out += "\\u00";
+                        out += hex[c >> 4];
+                        out += hex[c & 15];
+                    } else {
+                        out += ch;
+                    }
+            }
+        }
+        out += '"';
+        return out;
+    }
+}
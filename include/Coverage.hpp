@@ -0,0 +1,51 @@
+#pragma once
+
+#include "IgnoreMatcher.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct CoverageOptions {
+    unsigned threads = 0;  // 0 = one per core
+    std::size_t top = 10;  // entries in each "largest" list
+};
+
+struct CoverageReport {
+    struct Pattern {
+        std::uint64_t files = 0;  // files decided by the rule, directly or via a directory
+        std::uint64_t bytes = 0;
+        std::uint64_t dirs = 0;   // directories the rule matched itself
+    };
+
+    struct Item {
+        std::string path;
+        std::uint64_t bytes = 0;
+        std::uint64_t files = 0;
+    };
+
+    std::vector<Pattern> patterns;     // indexed like the matcher's rules
+    std::vector<Item> largest_files;   // untracked and not ignored, largest first
+    std::vector<Item> largest_dirs;    // directories git status shows as untracked
+    std::uint64_t files = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t ignored_files = 0;
+    std::uint64_t ignored_bytes = 0;
+    bool tracked_known = false;        // false outside a git work tree
+};
+
+// Walks a tree once, in parallel, and attributes every file to the rule of
+// one compiled IgnoreMatcher that decides it. Directories that a rule
+// excludes are still walked, for their sizes, but nothing below them is
+// matched again. Tracked files come from `git ls-files`.
+class Coverage {
+public:
+    explicit Coverage(const IgnoreMatcher& matcher, CoverageOptions opts = {});
+
+    CoverageReport run(const std::filesystem::path& root) const;
+
+private:
+    const IgnoreMatcher& matcher;
+    CoverageOptions opts;
+};
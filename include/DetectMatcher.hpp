@@ -0,0 +1,116 @@
+#pragma once
+
+#include "TemplateStore.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// All `# @detect:` patterns of a template set compiled into one matcher.
+// Exact file names and `*.ext` globs are resolved through hash tables; only
+// patterns with real wildcards fall back to fnmatch. Matching is
+// case-insensitive, like FNM_CASEFOLD.
+//
+// `# @content: <file> <text>` rules are compiled alongside: `<file>` is a
+// name pattern as above, or `(noext)` for names without a dot, and selects
+// the files whose first bytes are searched for `<text>` (the rest of the
+// line, case-sensitive; a leading '^' anchors it to the start of the file).
+class DetectMatcher {
+public:
+    struct ContentRule {
+        std::uint32_t tmpl;
+        std::string text;
+        bool anchored = false;
+
+        bool matches(std::string_view prefix) const {
+            return anchored ? prefix.starts_with(text) : prefix.find(text) != std::string_view::npos;
+        }
+    };
+
+    // `strings` holds the text of the templates' interned patterns and
+    // rules; each distinct pattern is compiled once.
+    DetectMatcher(const std::vector<TemplateStore::Template>& templates, const StringPool& strings);
+
+    // Calls on_match(index) for every template (index into `templates`) with
+    // a pattern matching the file name. An index may be reported repeatedly.
+    template <typename F>
+    void match(std::string_view name, F&& on_match) const;
+
+    // Appends to `out` the content rules that select the file `name`.
+    void match_content(std::string_view name, std::vector<std::uint32_t>& out) const;
+
+    const ContentRule& content_rule(std::uint32_t i) const { return content_rules[i]; }
+    bool has_content_rules() const { return !content_rules.empty(); }
+
+    std::size_t template_count() const { return count; }
+    std::size_t glob_count() const { return globs.size(); }  // patterns left to fnmatch
+
+    // True if some pattern or content rule of the template can match a file
+    // name that does not start with a dot. Patterns naming dot files or paths never match
+    // during a detection walk.
+    bool matchable(std::uint32_t tmpl) const { return reachable[tmpl] != 0; }
+
+private:
+    struct Hash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view s) const {
+            return std::hash<std::string_view>{}(s);
+        }
+    };
+    using Table = std::unordered_map<std::string, std::vector<std::uint32_t>,
+                                     Hash, std::equal_to<>>;
+
+    struct Glob {
+        std::string pattern;
+        std::uint32_t tmpl;
+    };
+
+    Table exact;
+    Table extensions;
+    std::vector<Glob> globs;
+    std::vector<char> reachable;
+
+    std::vector<ContentRule> content_rules;
+    Table content_exact;                     // file names to rule indexes
+    std::vector<Glob> content_globs;         // Glob::tmpl holds a rule index
+    std::vector<std::uint32_t> content_noext;
+    std::size_t count = 0;
+
+    static constexpr std::size_t max_name = 256;
+
+    bool glob_matches(const Glob& g, std::string_view name, std::string_view ext) const;
+};
+
+template <typename F>
+void DetectMatcher::match(std::string_view name, F&& on_match) const {
+    if (name.empty() || name.size() >= max_name) return;
+
+    char folded[max_name];
+    for (std::size_t i = 0; i < name.size(); i++) {
+        char c = name[i];
+        folded[i] = (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+    }
+    std::string_view key(folded, name.size());
+
+    if (auto it = exact.find(key); it != exact.end())
+        for (auto t : it->second) on_match(t);
+
+    auto last_dot = key.rfind('.');
+    if (last_dot != std::string_view::npos && !extensions.empty()) {
+        for (auto dot = key.find('.'); dot != std::string_view::npos; dot = key.find('.', dot + 1)) {
+            if (auto it = extensions.find(key.substr(dot + 1)); it != extensions.end())
+                for (auto t : it->second) on_match(t);
+        }
+    }
+
+    if (!globs.empty()) {
+        // std::filesystem::path::extension() semantics: a leading dot does not
+        // start an extension.
+        std::string_view ext;
+        if (last_dot != std::string_view::npos && last_dot != 0) ext = name.substr(last_dot);
+        for (const auto& g : globs)
+            if (glob_matches(g, name, ext)) on_match(g.tmpl);
+    }
+}
@@ -1,19 +1,52 @@
 #pragma once
 
+#include "DetectMatcher.hpp"
 #include "TemplateStore.hpp"
 
+#include <chrono>
+#include <cstddef>
 #include <filesystem>
 #include <string>
 #include <vector>
 
+struct DetectOptions {
+    unsigned threads = 0;                     // walker threads, 0 = one per core
+    std::size_t max_entries = 0;              // stop after this many entries, 0 = no limit
+    std::chrono::milliseconds time_budget{0}; // stop after this long, 0 = no limit
+    bool prune_defaults = true;               // skip default_prune_dirs() subtrees
+    bool gitignore = true;                    // skip directories .gitignore files exclude
+    std::vector<std::string> prune;           // more directory names to skip
+};
+
+struct DetectResult {
+    std::vector<std::string> templates;
+    bool partial = false;     // a budget ran out before the walk finished
+    std::size_t entries = 0;  // entries visited
+};
+
+// Matches every entry against the compiled @detect patterns as it is
+// visited, keeping only a bitset of matched templates. The walk ends as soon
+// as every template that can still match has matched. Generated trees such
+// as node_modules, and directories the project's .gitignore files exclude,
+// are matched by name but never opened. Files selected by `# @content:`
+// rules are collected during the walk and their first few kilobytes read
+// in one batch afterwards, for templates the names did not settle. The matcher is built
+// once up front, so one Detector can serve concurrent detect() calls.
 class Detector {
 public:
-    explicit Detector(TemplateStore& store);
+    // Bytes of each candidate file searched by content rules.
+    static constexpr std::size_t content_prefix = 4096;
+    // Candidate files read per detection; more are ignored.
+    static constexpr std::size_t max_content_candidates = 4096;
 
-    std::vector<std::string> detect(const std::filesystem::path& dir);
+    explicit Detector(TemplateStore& store, DetectOptions opts = {});
 
-private:
-    TemplateStore& store;
+    DetectResult detect(const std::filesystem::path& dir) const { return detect(dir, opts); }
+    // With other budgets or prune settings than the constructor's.
+    DetectResult detect(const std::filesystem::path& dir, const DetectOptions& opts) const;
 
-    bool pattern_matches(const std::string& name, const std::string& pattern);
+private:
+    const std::vector<TemplateStore::Template>& templates;
+    DetectOptions opts;
+    DetectMatcher matcher;
 };
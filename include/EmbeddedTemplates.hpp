@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+struct EmbeddedTemplate {
+    std::string_view name;
+    std::string_view content;
+    const std::string_view* detect_patterns;
+    std::size_t detect_count;
+    const std::string_view* content_rules;
+    std::size_t content_count;
+    std::uint64_t hash;  // TemplateStore::content_hash(content)
+};
+
+// Bundled templates compiled into the executable at build time, sorted by
+// name. Empty when built with -Dembed_templates=false.
+std::span<const EmbeddedTemplate> embedded_templates();
+
+// Directory names the bundled templates ignore wherever they appear, such as
+// node_modules and target, sorted. Detection does not descend into them.
+// Generated from the templates even when they are not embedded.
+std::span<const std::string_view> default_prune_dirs();
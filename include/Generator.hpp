@@ -0,0 +1,106 @@
+#pragma once
+
+#include "TemplateStore.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
+
+struct GenerateOptions {
+    std::filesystem::path output = ".gitignore";
+    bool append = false;              // add only what the file lacks, see append_missing()
+    bool preview = false;             // write to preview_fd instead of output
+    bool merge = false;               // emit each pattern once across templates
+    int preview_fd = STDOUT_FILENO;
+};
+
+struct DroppedPattern {
+    std::string pattern;
+    std::string template_name;  // template the line was dropped from
+    std::string first;          // template that already contributed it
+};
+
+struct GenerateResult {
+    std::vector<std::string> templates;  // templates rendered, in order
+    std::vector<std::string> missing;    // requested names without a template
+    std::vector<DroppedPattern> dropped; // duplicates removed by merge or append
+    std::vector<std::string> present;    // append: left out, the file has them already
+    std::string error;                   // empty on success
+};
+
+// What the header of a generated file records about how it was made.
+struct Stamp {
+    bool merged = false;
+    std::vector<std::string> templates;  // in file order
+    std::vector<std::uint64_t> hashes;   // TemplateStore::content_hash, empty in older files
+};
+
+struct CheckResult {
+    std::vector<std::string> changed;  // template differs from the one stamped
+    std::vector<std::string> missing;  // template no longer found
+    std::string error;                 // not a generated file, or unreadable
+
+    bool stale() const { return !changed.empty() || !missing.empty(); }
+};
+
+// Renders templates into a .gitignore. Nothing is printed, so it can run for
+// many repositories at once against one shared store.
+//
+// The header of a generated file names its templates and stamps each with
+// the hash of its body, so check() can tell a stale file from the header
+// and the catalogue index alone, and update() can re-render just the
+// sections whose template changed. A file can hold several such blocks,
+// one per --append, each with its own header; all of them are checked.
+//
+// Template bodies are never copied: the output is assembled as an iovec of
+// the mmap'd bodies and the small generated headers and written with
+// writev. Large file bodies are copied with copy_file_range where the
+// output allows it. With merge, bodies are split into runs of kept lines,
+// still without copying.
+class Generator {
+public:
+    explicit Generator(TemplateStore& store);
+
+    GenerateResult generate(const std::vector<std::string>& names,
+                            const GenerateOptions& opts);
+
+    // Compares the hashes stamped into `file` with the templates' current
+    // ones. Reads the file's headers; no template body is opened.
+    CheckResult check(const std::filesystem::path& file);
+
+    // Re-renders the sections of `file` whose template changed and copies
+    // everything else as it is: hand edits, other blocks, and the sections
+    // of templates no longer found. Merged sections after a re-rendered one
+    // are merged again from their templates, keeping their hand edits. The
+    // file is replaced through a temporary and a rename, and not touched
+    // unless a template changed. result.templates lists the re-rendered
+    // templates. A file without hashes counts every template as changed.
+    // If a section is missing, or its lines cannot be told from ones added
+    // by hand, result.error says so and the file is left alone.
+    GenerateResult update(const std::filesystem::path& file);
+
+    // The part of a .gitignore before the first block autoignore generated
+    // in it: what the project wrote itself. Detection prunes by this much
+    // only, or it would depend on its own last result.
+    static std::string_view hand_written(std::string_view text);
+
+private:
+    // A header and the sections after it, up to the next header.
+    struct Block {
+        Stamp stamp;
+        std::size_t start = 0;  // of the header
+        std::size_t body = 0;   // of the first section
+        std::size_t end = 0;
+    };
+
+    TemplateStore& store;
+
+    // The blocks of a generated file, in order; none if it was not
+    // generated by autoignore.
+    static std::vector<Block> parse_blocks(std::string_view text);
+
+    CheckResult compare(const Stamp& stamp);
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// gitignore patterns compiled for bulk matching, with git's semantics:
+// negation, trailing-slash directory rules, anchoring by a leading or inner
+// slash, `*`, `?`, `[...]` and `**` wildcards, and last match wins. Literal
+// names, `*suffix` rules and literal paths are resolved through hash tables;
+// only the remaining globs are tried one by one, behind cheap checks of
+// their literal parts.
+class IgnoreMatcher {
+public:
+    struct Rule {
+        std::string text;      // the line as written, trailing spaces removed
+        std::string pattern;   // without '!', leading and trailing '/'
+        std::uint32_t source;  // index into the source labels
+        std::uint32_t line;    // 1-based line in the source
+        bool negated = false;
+        bool dir_only = false;
+        bool anchored = false;  // matched against the whole path, not the name
+    };
+
+    // Appends the patterns in `content`, which take precedence over the ones
+    // added before. `source` labels them in reports.
+    void add(std::string_view content, std::string source);
+
+    // Index of the last rule matching `path` itself, or -1. Paths are
+    // relative to the directory of the patterns, '/'-separated, without
+    // leading or trailing slash.
+    int match(std::string_view path, bool is_dir) const;
+
+    // Like match(), but a path inside an excluded directory is excluded by
+    // that directory's rule whatever later rules say, as in git. Verdicts for
+    // the parent directories of the previous path are cached, so sorted
+    // input costs about one match() per path. Not thread-safe.
+    int check(std::string_view path, bool is_dir);
+
+    bool ignores(int rule) const { return rule >= 0 && !rules[rule].negated; }
+    const Rule& rule(int i) const { return rules[i]; }
+    const std::string& source(const Rule& r) const { return sources[r.source]; }
+    std::size_t size() const { return rules.size(); }
+
+private:
+    struct Hash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view s) const {
+            return std::hash<std::string_view>{}(s);
+        }
+    };
+    using Table = std::unordered_map<std::string, std::vector<std::uint32_t>,
+                                     Hash, std::equal_to<>>;
+
+    // A glob is only run if the text starts with its literal prefix, ends
+    // with its literal suffix and contains its other literal characters.
+    struct Glob {
+        std::uint32_t rule;
+        std::uint32_t prefix;  // lengths within the rule's pattern
+        std::uint32_t suffix;
+        std::uint64_t mask;
+    };
+
+    std::vector<Rule> rules;
+    std::vector<std::string> sources;
+    Table names;                      // literal name rules
+    Table suffixes;                   // "*lit.eral" name rules, keyed from the first dot
+    std::vector<std::uint32_t> ends;  // "*literal" name rules without a dot
+    Table paths;                      // literal anchored rules
+    std::vector<Glob> name_globs;
+    std::vector<Glob> path_globs;
+
+    // Parent directory cache for check(): the directory part of the last
+    // path, and for each of its components the end offset and the rule
+    // excluding it (or an ancestor), -1 if none.
+    std::string cached_dir;
+    std::vector<std::pair<std::size_t, int>> cached;
+
+    static std::uint64_t mask_of(std::string_view text);
+    static Glob compile_glob(std::uint32_t rule, std::string_view pattern);
+};
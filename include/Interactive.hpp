@@ -16,10 +16,14 @@ private:
     struct termios* orig_termios = nullptr;
     bool raw_active = false;
 
+    // Lines currently on screen; the cursor rests on the line below them.
+    std::vector<std::string> frame;
+    std::string out;
+
     enum Key { K_UP = 1000, K_DOWN, K_ENTER, K_SPACE, K_QUIT, K_BACKSPACE };
 
     void enable_raw();
     void disable_raw();
     int read_key();
-    void move_up_and_clear(int lines);
+    void present(const std::vector<std::string>& next);
 };
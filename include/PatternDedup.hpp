@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Tracks the gitignore pattern lines already written so that later repeats
+// can be dropped without changing what the file ignores. A repeated pattern
+// is only redundant if no line of the opposite sign that can match the same
+// paths came after its last occurrence: `*.log` after `!keep.log` re-ignores
+// keep.log and must stay. Two lines are assumed to overlap unless both are
+// free of wildcards and end in different names.
+//
+// Keys are views into the admitted lines, which must outlive the object.
+class PatternDedup {
+public:
+    // The pattern a line stands for: trailing CR and unescaped trailing
+    // spaces removed, and a redundant leading "**/" dropped. Empty for blank
+    // lines and comments.
+    static std::string_view normalize(std::string_view line);
+
+    // Records the line and returns true if it has to be written. Returns
+    // false for a redundant repeat, setting *first to the origin that
+    // contributed it first.
+    bool admit(std::string_view line, std::uint32_t origin, std::uint32_t* first = nullptr);
+
+private:
+    struct Seen {
+        std::uint64_t last;   // sequence number of the latest occurrence
+        std::uint32_t origin;
+    };
+
+    struct Emitted {
+        std::string_view key;
+        std::uint64_t seq;
+    };
+
+    std::unordered_map<std::string_view, Seen> seen;
+    std::vector<Emitted> positives;  // in emission order
+    std::vector<Emitted> negations;
+    std::uint64_t seq = 0;
+
+    static bool may_overlap(std::string_view a, std::string_view b);
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Reads the first `limit` bytes of many files. Where the kernel offers
+// io_uring the opens and reads are queued in batches, a system call per
+// batch rather than three per file; otherwise the files are spread over a
+// small pool of threads doing openat/pread. Unreadable files are skipped.
+//
+// Built without io_uring when <linux/io_uring.h> is missing or
+// AUTOIGNORE_NO_IO_URING is defined (-Dio_uring=false).
+class PrefixReader {
+public:
+    explicit PrefixReader(std::size_t limit, unsigned threads = 0);
+
+    // Calls on_read(i, prefix) for each paths[i] that could be read, in no
+    // particular order and never concurrently. Paths are relative to
+    // dir_fd. The prefix is only valid during the call.
+    void read(int dir_fd, const std::vector<std::string>& paths,
+              const std::function<void(std::size_t, std::string_view)>& on_read) const;
+
+private:
+    std::size_t limit;
+    unsigned threads;
+
+    bool read_uring(int dir_fd, const std::vector<std::string>& paths,
+                    const std::function<void(std::size_t, std::string_view)>& on_read) const;
+    void read_pool(int dir_fd, const std::vector<std::string>& paths,
+                   const std::function<void(std::size_t, std::string_view)>& on_read) const;
+};
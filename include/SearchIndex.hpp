@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Ranked, typo-tolerant name search in the spirit of fzf. Names are
+// case-folded into one buffer up front, each with a bitmask of the
+// characters it contains, so most names are rejected with a single AND.
+// Survivors are scored as substring, subsequence (with bonuses for
+// consecutive characters and word boundaries) or, failing both, by
+// Damerau-Levenshtein distance to the query. Queries reuse internal
+// buffers and do not allocate once the index is built.
+//
+// A query that extends the previous one (a character typed at the end) only
+// rescans the names that survived the previous character-mask filter.
+class SearchIndex {
+public:
+    struct Hit {
+        std::uint32_t id;  // position in the names given to the constructor
+        int score;
+    };
+
+    explicit SearchIndex(const std::vector<std::string>& names);
+
+    // Matches ordered by descending score, then by id. An empty query
+    // matches everything with score 0. The result stays valid until the
+    // next call.
+    const std::vector<Hit>& query(std::string_view q);
+
+    std::size_t size() const { return masks.size(); }
+
+private:
+    std::string folded;                  // all names, case-folded, back to back
+    std::vector<std::uint32_t> offsets;  // name i is folded[offsets[i], offsets[i+1])
+    std::vector<std::uint64_t> masks;
+    std::vector<Hit> hits;
+    std::vector<std::uint32_t> survivors;  // may still match last_query + anything
+    char query_buf[64];
+    char last_query[64];
+    std::size_t last_len = 0;
+    bool have_last = false;
+
+    std::string_view name(std::uint32_t id) const {
+        return std::string_view(folded).substr(offsets[id], offsets[id + 1] - offsets[id]);
+    }
+
+    static std::uint64_t mask_of(std::string_view s);
+    static int max_typos(std::size_t query_len);
+    static int score(std::string_view name, std::string_view q);
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Detector.hpp"
+#include "TemplateStore.hpp"
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// `autoignore serve`: a resident process that keeps the template store, its
+// search index and the compiled detection matcher warm, and runs command
+// lines sent by clients over a Unix socket. The client passes its working
+// directory and its stdout and stderr descriptors along, so output, file
+// writes and relative paths behave as if it had run the command itself.
+// It also passes the template search path and index location its
+// environment ($AUTOIGNORE_PATH, $HOME, $XDG_CACHE_HOME) gives. A request
+// from a client whose templates would differ from the daemon's is
+// declined, and the client runs it itself. Changes to the template directories, seen through inotify, make
+// the next request reload the store.
+//
+// Protocol, one request per frame, any number per connection:
+//   request  u32 length, then "autoignore/2" NUL cwd NUL index NUL n NUL
+//            path NUL ... (n search paths) arg NUL arg ..., with stdout
+//            and stderr attached as SCM_RIGHTS
+//   reply    i32 exit status; none for a declined request
+// Only processes of the same user are served, and served by.
+class Server {
+public:
+    // Runs one client command line against the warm store and detector;
+    // returns its exit status.
+    using Handler = std::function<int(TemplateStore&, const Detector&, std::vector<std::string>)>;
+
+    Server(std::filesystem::path socket, Handler handler);
+    ~Server();
+
+    // Serves until SIGINT or SIGTERM. Returns the exit status.
+    int run();
+
+    // $AUTOIGNORE_SOCKET, else $XDG_RUNTIME_DIR/autoignore.sock, else
+    // /tmp/autoignore-<uid>.sock. Empty if $AUTOIGNORE_SOCKET is set but
+    // empty, which turns client mode off.
+    static std::filesystem::path default_socket();
+
+    // Client side: runs `args` in the daemon listening on `socket`. Returns
+    // the exit status, or -1 if no daemon took the request, in which case
+    // the caller does the work itself.
+    static int forward(const std::filesystem::path& socket, const std::vector<std::string>& args);
+
+private:
+    std::filesystem::path socket_path;
+    Handler handler;
+    TemplateStore store;
+    std::unique_ptr<Detector> detector;
+    int listen_fd = -1;
+    int inotify_fd = -1;
+    bool stale = false;  // the template directories changed since the last load
+
+    void load();
+    void watch_paths();
+    void serve_connection(int fd);
+    bool serve_request(int fd);
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Opt-in instrumentation behind --stats-json and --trace: wall time per
+// phase and a handful of counters, recorded by TemplateStore, Detector,
+// Walker and Generator. Nothing is recorded unless a Stats object exists;
+// until then every hook is a test of one null pointer, and the hooks sit
+// outside per-entry loops (the walker adds its counts once per directory).
+class Stats {
+public:
+    enum Counter : unsigned {
+        template_dirs_scanned,  // template directories listed (index out of date)
+        headers_parsed,         // template headers read for @detect/@content
+        templates,              // templates in the catalogue
+        dirs_opened,            // directories read by the walker
+        entries,                // entries visited by the walker
+        entries_pruned,         // directories not descended into: prune list or .gitignore
+        matcher_calls,          // file names run through the compiled @detect matcher
+        glob_checks,            // wildcard patterns tried against those names
+        content_files_read,     // files read for @content rules
+        bytes_read,             // .gitignore files and @content prefixes
+        bytes_written,          // generated output
+        counter_count
+    };
+
+    // Installs this object as the recorder for the whole process; only one
+    // may exist at a time.
+    Stats();
+    ~Stats();
+    Stats(const Stats&) = delete;
+    Stats& operator=(const Stats&) = delete;
+
+    static Stats* current() { return active; }
+
+    static void count(Counter c, std::uint64_t n = 1) {
+        if (active) active->counters[c].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void record(const char* phase, std::chrono::steady_clock::time_point start,
+                std::chrono::steady_clock::time_point end);
+
+    // {"wall_ms", "peak_rss_kb", "phases": {name: {"ms", "calls"}}, "counters"}
+    void write_json(std::ostream& out) const;
+    // Chrome trace-event format, for chrome://tracing or Perfetto.
+    void write_trace(std::ostream& out) const;
+
+private:
+    struct Span {
+        const char* name;
+        std::int64_t start_us;
+        std::int64_t duration_us;
+        int tid;
+    };
+
+    static inline Stats* active = nullptr;
+
+    std::chrono::steady_clock::time_point origin;
+    std::array<std::atomic<std::uint64_t>, counter_count> counters{};
+    mutable std::mutex m;
+    std::vector<Span> spans;
+
+    static const char* counter_name(Counter c);
+};
+
+// Records the lifetime of the object as one span of the phase `name`,
+// which must be a string literal.
+class StatsPhase {
+public:
+    explicit StatsPhase(const char* name) : name(name), stats(Stats::current()) {
+        if (stats) start = std::chrono::steady_clock::now();
+    }
+    ~StatsPhase() {
+        if (stats) stats->record(name, start, std::chrono::steady_clock::now());
+    }
+    StatsPhase(const StatsPhase&) = delete;
+    StatsPhase& operator=(const StatsPhase&) = delete;
+
+private:
+    const char* name;
+    Stats* stats;
+    std::chrono::steady_clock::time_point start;
+};
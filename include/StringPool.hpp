@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Append-only storage for the template catalogue. Strings are copied into
+// large blocks, NUL-terminated, so views of them stay valid, and usable as
+// C strings, until clear(). intern() also numbers distinct strings, so that
+// a pattern shared by many templates is stored once and compares as an
+// integer.
+class StringPool {
+public:
+    using Id = std::uint32_t;
+
+    StringPool() = default;
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    std::string_view store(std::string_view s);  // a copy, not interned
+    std::string_view store(std::initializer_list<std::string_view> parts);  // joined
+    Id intern(std::string_view s);
+    std::string_view operator[](Id id) const { return interned[id]; }
+    std::size_t size() const { return interned.size(); }  // distinct interned strings
+
+    // Uninitialised room for n objects of a trivial type.
+    template <typename T>
+    std::span<T> allocate(std::size_t n) {
+        return std::span<T>(reinterpret_cast<T*>(raw(n * sizeof(T), alignof(T))), n);
+    }
+
+    void clear();
+
+private:
+    // Blocks start small, for the few templates of a fresh install, and
+    // double up to max_block.
+    static constexpr std::size_t first_block = 4 * 1024;
+    static constexpr std::size_t max_block = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::size_t block_size = first_block;
+    char* next = nullptr;
+    std::size_t left = 0;
+    std::vector<std::string_view> interned;
+    std::unordered_map<std::string_view, Id> ids;
+
+    char* raw(std::size_t n, std::size_t align);
+};
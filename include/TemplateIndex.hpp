@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// On-disk cache of the template search directories, so that startup does not
+// have to list every directory and re-read every template header. A
+// directory's records are reused as long as its mtime and each file's size
+// and mtime are unchanged, which takes a stat per file but no listing or
+// reads; otherwise it is relisted, reusing records of files whose size and
+// mtime match. Each directory's files are kept sorted by name.
+//
+// A loaded index keeps the file mapped: the strings of its records view the
+// mapping and stay valid as long as the TemplateIndex does.
+class TemplateIndex {
+public:
+    struct File {
+        std::string_view name;   // the file is <Dir::path>/<name>.gitignore
+        std::uint64_t size = 0;
+        std::int64_t mtime = 0;  // nanoseconds
+        std::vector<std::string_view> detect_patterns;
+        std::vector<std::string_view> content_rules;  // "<file> <text>", as written
+        std::uint64_t hash = 0;                        // TemplateStore::content_hash of the file
+    };
+
+    struct Dir {
+        fs::path path;
+        std::int64_t mtime = 0;  // nanoseconds, 0 if missing
+        bool exists = false;
+        std::vector<File> files;
+    };
+
+    // $XDG_CACHE_HOME/autoignore/index.bin, or ~/.cache/...; empty if neither
+    // variable is set.
+    static fs::path default_location();
+
+    // Maps and decodes the index; dirs() is empty if the file is missing,
+    // truncated, out of order or from another format version.
+    explicit TemplateIndex(const fs::path& file);
+    TemplateIndex(const TemplateIndex&) = delete;
+    TemplateIndex& operator=(const TemplateIndex&) = delete;
+    ~TemplateIndex();
+
+    std::vector<Dir>& dirs() { return list; }
+    // The record of `file`, a <dir>/<name>.gitignore path, or nullptr.
+    const File* find(std::string_view file) const;
+
+    // Replaces the index atomically; failures are ignored by callers since
+    // the index is only a cache.
+    static bool save(const fs::path& file, const std::vector<Dir>& dirs);
+
+private:
+    void* map = nullptr;
+    std::size_t size = 0;
+    std::vector<Dir> list;
+};
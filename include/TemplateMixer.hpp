@@ -0,0 +1,33 @@
+#pragma once
+
+#include "TemplateStore.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Catalogue reports and template-combination analysis, run on the shared
+// TemplateStore: descriptions come from a bounded read of each template's
+// header, and each template in a mix is mapped and scanned once.
+class TemplateMixer {
+public:
+    explicit TemplateMixer(TemplateStore& store);
+
+    void set_verbose(bool v) { verbose = v; }
+
+    void list_templates_detailed();
+    void preview_mix(const std::vector<std::string>& template_names);
+    std::vector<std::string> suggest_templates(const std::string& project_hint = "");
+    void show_template_statistics();
+    // The search path in order, built-ins included, with what each holds.
+    void show_locations();
+    std::vector<std::string> optimize_template_selection(std::vector<std::string> template_names);
+
+private:
+    TemplateStore& store;
+    bool verbose = false;
+
+    static std::string extract_description(std::string_view header);
+    static std::string format_size(std::uint64_t size);
+    static void optimize_template_order(std::vector<std::string>& template_names);
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Many templates in one file, built by `autoignore pack`: a table of fixed
+// size entries sorted by name, holding each template's @detect and
+// @content headers and content hash, followed by the bodies. The file is
+// mmap'd and checked once on open; looking up a template is a binary search
+// of the table and reading it touches only its body.
+//
+// Bodies are stored deflated when that makes them smaller and the pack was
+// built with compression. Built without zlib when <zlib.h> is missing or
+// AUTOIGNORE_NO_ZLIB is defined (-Dzlib=false); such a build neither writes
+// nor reads compressed bodies.
+class TemplatePack {
+public:
+    struct Source {
+        std::string name;
+        std::string body;
+        std::vector<std::string> detect_patterns;
+        std::vector<std::string> content_rules;
+        std::uint64_t hash = 0;  // TemplateStore::content_hash(body)
+    };
+
+    // nullptr if the file cannot be mapped or is not a well-formed pack.
+    static std::unique_ptr<TemplatePack> open(const fs::path& file);
+    // Replaces `file` atomically with a pack of `templates`, which must
+    // have unique names.
+    static bool write(const fs::path& file, std::vector<Source> templates, bool compress);
+    static bool compression_supported();
+
+    TemplatePack(const TemplatePack&) = delete;
+    TemplatePack& operator=(const TemplatePack&) = delete;
+    ~TemplatePack();
+
+    std::size_t size() const { return count; }
+    std::string_view name(std::size_t i) const;
+    std::uint64_t hash(std::size_t i) const;
+    std::uint64_t body_size(std::size_t i) const;  // uncompressed
+    bool compressed(std::size_t i) const;
+    // Views of the pack.
+    void headers(std::size_t i, std::vector<std::string_view>& detect_patterns,
+                 std::vector<std::string_view>& content_rules) const;
+    // Index of the first name not less than `name`; size() if none.
+    std::size_t lower_bound(std::string_view name) const;
+    std::size_t find(std::string_view name) const;  // size() if absent
+    // The body of entry i: a view of the mapping, or of `buffer` once
+    // inflated into it. Empty if it cannot be inflated.
+    std::string_view body(std::size_t i, std::unique_ptr<char[]>& buffer) const;
+
+private:
+    struct Entry;
+
+    const char* data = nullptr;
+    std::size_t length = 0;
+    std::size_t count = 0;
+
+    TemplatePack() = default;
+    Entry entry(std::size_t i) const;
+};
@@ -1,32 +1,136 @@
 #pragma once
 
+#include "SearchIndex.hpp"
+#include "StringPool.hpp"
+#include "TemplateIndex.hpp"
+#include "TemplatePack.hpp"
+
+#include <cstdint>
 #include <filesystem>
+#include <memory>
+#include <span>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace fs = std::filesystem;
 
+struct EmbeddedTemplate;
+
 class TemplateStore {
 public:
+    // Holds no memory of its own: strings and lists live in the store's
+    // pool, or in the executable or the pack they come from, until
+    // reload().
     struct Template {
-        std::string name;
-        fs::path path;
-        std::vector<std::string> detect_patterns;
+        std::string_view name;
+        std::string_view path;        // NUL-terminated; empty for built-in templates, the
+                                      // pack for packed ones
+        std::uint64_t size = 0;
+        std::int64_t mtime = 0;       // nanoseconds, 0 for built-ins and packed templates
+        std::span<const StringPool::Id> detect_patterns;  // interned, see strings()
+        std::span<const StringPool::Id> content_rules;    // "# @content:" lines, "<file> <text>"
+        std::uint64_t hash = 0;       // content_hash() of the body, kept in the index
+        std::string_view builtin;     // content of a built-in template
+        const TemplatePack* pack = nullptr;  // set for packed templates, with
+        std::uint32_t pack_entry = 0;        // their index in the pack
+        std::uint32_t dir = 0;        // index in paths() of its directory or pack; 0 for built-ins
+        bool hashed = true;           // false if find() read only the header: see current_hash()
+    };
+
+    // Read-only view of a template body without copying it: file
+    // templates are mmap'd, built-ins point into the executable and packed
+    // ones into the pack, unless stored compressed.
+    class Body {
+    public:
+        Body() = default;
+        Body(Body&& other) noexcept;
+        Body& operator=(Body&& other) noexcept;
+        ~Body();
+
+        std::string_view view() const { return data; }
+        int fd() const { return file; }  // -1 for built-ins
+
+    private:
+        friend class TemplateStore;
+        std::string_view data;
+        void* map = nullptr;
+        int file = -1;
+        std::unique_ptr<char[]> inflated;
     };
 
+    // Searches $AUTOIGNORE_PATH, a colon-separated list of template
+    // directories and packs, then the user, /usr/local and system
+    // directories; a template found earlier overrides one of the same name
+    // found later.
     TemplateStore();
 
     const std::vector<Template>& all();
+    // Rescan changed directories on the next all(). Invalidates every
+    // Template handed out.
+    void reload() {
+        cache_valid = false;
+        probed.clear();
+        packs.clear();
+        index.reset();
+        pool.clear();
+    }
+    // Once all() has run, a hash lookup. Before, probes for the one
+    // template in search order, <dir>/<name>.gitignore, the pack or the
+    // built-ins, so that generating from names never loads the catalogue.
     const Template* find(const std::string& name);
-    std::vector<const Template*> search(const std::string& query);
+    std::vector<const Template*> search(const std::string& query);  // best match first
+    // Sorted, unique names starting with `prefix`, for shell completion:
+    // one readdir per search directory, no stat, no header and no index.
+    std::vector<std::string> names(std::string_view prefix) const;
     std::string read_content(const Template& t) const;
+    Body open_content(const Template& t) const;  // empty view on error
+    std::string read_header(const Template& t, std::size_t limit = 4096) const;  // whole lines only
     const std::vector<fs::path>& paths() const;
+    // Text of the patterns and content rules of templates.
+    const StringPool& strings() const { return pool; }
+    // @detect and @content headers of a template body, which parsing stops
+    // at the first blank or non-comment line.
+    static void parse_header(std::string_view content, std::vector<std::string>& detect_patterns,
+                             std::vector<std::string>& content_rules);
+    // 64-bit FNV-1a of a template body, as stamped into generated files.
+    // Passing the hash of what came before continues it, so a body can be
+    // hashed a piece at a time.
+    static std::uint64_t content_hash(std::string_view content, std::uint64_t h = 0xcbf29ce484222325);
+    // The hash of the template as it is now: t.hash, after a stat showing
+    // that the file was not rewritten in place since it was indexed. For a
+    // template find() probed, whose body was not read, the index record
+    // if it is current, else the hash of `body` or of the file.
+    std::uint64_t current_hash(const Template& t, const Body* body = nullptr);
+    std::size_t builtin_position() const { return builtin_pos; }
+    // paths() before this one are the user's: $AUTOIGNORE_PATH and ~/.local.
+    std::size_t user_paths() const { return user_count; }
 
 private:
     std::vector<fs::path> search_paths;
+    std::size_t builtin_pos = 0;  // built-ins rank just before search_paths[builtin_pos]
+    std::size_t user_count = 0;
+    StringPool pool;
     std::vector<Template> cache;
+    std::vector<std::uint32_t> slots;  // hash table of names in cache, see index_names()
+    std::unordered_map<std::string_view, Template> probed;  // found by find() before all()
+    std::vector<std::unique_ptr<TemplatePack>> packs;  // per search path, null for directories
+    std::unique_ptr<TemplateIndex> index;  // loaded by current_hash() for probed templates
     bool cache_valid = false;
+    std::unique_ptr<SearchIndex> search_index;
 
     void init_paths();
-    std::vector<std::string> parse_detect_patterns(const fs::path& path);
+    const Template* probe(const std::string& name);
+    template <typename Strings>
+    std::span<const StringPool::Id> intern(const Strings& items);
+    Template builtin_template(const EmbeddedTemplate& e);
+    Template packed_template(std::size_t dir, std::size_t entry);
+    Template file_template(std::size_t dir, const TemplateIndex::File& f);
+    static constexpr std::uint32_t empty_slot = UINT32_MAX;
+    void index_names();
+    std::size_t slot(std::string_view name) const;
+    void scan_dir(TemplateIndex::Dir& dir, const TemplateIndex::Dir* previous);
+    void parse_header(const fs::path& path, TemplateIndex::File& f);
+    void intern_header(std::string_view content, TemplateIndex::File& f);
 };
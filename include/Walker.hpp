@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct WalkOptions {
+    unsigned threads = 0;     // 0 = one per core
+    int max_depth = 3;        // deepest entry depth visited, -1 = unlimited
+    bool skip_hidden = true;  // skip dot entries and never descend into them
+    bool stat_files = false;  // fill Entry::size with an lstat per file
+    bool gitignore = false;   // do not descend into directories that the
+                              // .gitignore files met on the way ignore,
+                              // outside the blocks autoignore generated
+    std::vector<std::string> prune;  // directory names never descended into
+    // Called concurrently with each directory opened, relative to the root
+    // ("" for the root), before its entries are read.
+    std::function<void(std::string_view dir)> on_open;
+};
+
+// Directory tree walker built on openat/getdents64. Entry types come from
+// the dirent d_type, so no per-entry stat is issued on common filesystems.
+// Subdirectories are spread across a work-stealing thread pool; unreadable
+// directories are skipped silently. Pruned directories (by name or by a
+// .gitignore) are still visited but never opened.
+class Walker {
+public:
+    struct Entry {
+        std::string_view name;
+        std::string_view dir;  // containing directory relative to the root, "" for the root
+        int depth;             // 0 for entries directly inside the root
+        bool is_dir;
+        std::uint64_t size;    // only with WalkOptions::stat_files, 0 for directories
+        // Caller-defined value of the containing directory (root_tag for the
+        // root).
+        // For a directory, the visitor may change it; the new value is what
+        // the directory's own entries see.
+        mutable std::uintptr_t tag;
+    };
+
+    // Called concurrently from the worker threads, `worker` being the index
+    // of the calling thread. Returning false for a directory skips its
+    // contents.
+    using Visitor = std::function<bool(unsigned worker, const Entry& entry)>;
+
+    explicit Walker(WalkOptions opts = {});
+
+    unsigned thread_count() const { return threads; }
+    void walk(const std::filesystem::path& root, const Visitor& visit, std::uintptr_t root_tag = 0);
+
+    // Ends the current walk early; safe to call from inside the visitor.
+    void stop() { stopped.store(true, std::memory_order_relaxed); }
+
+private:
+    WalkOptions opts;
+    unsigned threads;
+    std::atomic<bool> stopped{false};
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "DetectMatcher.hpp"
+#include "Detector.hpp"
+#include "IgnoreMatcher.hpp"
+#include "TemplateStore.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// `--detect --watch`: detection kept current as the tree changes. One full
+// walk counts, per template, the entries its @detect patterns (and @content
+// rules) match, and puts an inotify watch on every directory it opens.
+// After that each created, deleted or moved entry adjusts the counts by its
+// own name; a new directory is walked on its own, a removed one drops its
+// subtree. The template set is reported whenever it changes.
+//
+// The walk follows Detector's rules: same depth, prune list and .gitignore
+// handling, generated blocks left out. A change to a .gitignore other than
+// the one the watcher itself writes, or a lost event (queue overflow),
+// costs a fresh walk. When the inotify watch limit runs out, watching stops and
+// the tree is walked again every few seconds instead.
+class Watcher {
+public:
+    using OnChange = std::function<void(const std::vector<std::string>& templates)>;
+
+    Watcher(TemplateStore& store, DetectOptions opts = {});
+    ~Watcher();
+
+    // Watches `dir` until SIGINT or SIGTERM, calling on_change with the
+    // initial set and then with every different one. `output` is the file
+    // on_change writes, if any. Returns the exit status.
+    int run(const std::filesystem::path& dir, const OnChange& on_change,
+            const std::filesystem::path& output = {});
+
+private:
+    struct Node {
+        bool is_dir = false;
+        std::vector<std::uint32_t> content;  // templates matched by @content rules
+    };
+
+    const std::vector<TemplateStore::Template>& templates;
+    DetectOptions opts;
+    DetectMatcher matcher;
+    std::vector<std::string> prune;  // sorted
+    int max_depth;
+
+    std::filesystem::path root;
+    std::optional<std::string> own_gitignore;  // directory of the .gitignore run() writes
+    int inotify_fd = -1;
+    bool polling = false;            // the watch limit ran out
+    std::vector<std::uint32_t> counts;         // entries matching each template
+    std::map<std::string, Node> nodes;         // every entry seen, by path relative to root
+    std::unordered_map<int, std::string> dirs; // watch descriptor to directory
+    std::unordered_map<std::string, std::unique_ptr<IgnoreMatcher>> gitignores;  // by directory
+    std::mutex m;                              // guards the above during walks
+
+    void rescan();
+    void scan(const std::string& dir);
+    void watch(const std::string& dir);
+    void add(const std::string& path, bool is_dir);
+    void remove(const std::string& path);
+    std::vector<std::uint32_t> name_matches(std::string_view name) const;
+    void read_content(const std::vector<std::string>& paths);
+    void update_content(const std::string& path, std::string_view prefix);
+    bool descend(const std::string& path) const;
+    bool ignored(const std::string& dir);
+    bool handle_events();
+    std::vector<std::string> detected() const;
+};
@@ -0,0 +1,196 @@
+#include "Coverage.hpp"
+#include "Walker.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <memory>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+struct DirRecord {
+    std::string path;
+    DirRecord* parent;
+    int depth;
+    int excluded;            // rule excluding this directory or an ancestor, -1 if none
+    std::uint64_t bytes = 0; // untracked files that are not ignored
+    std::uint64_t files = 0;
+    bool tracked = false;    // holds a tracked file
+};
+
+struct WorkerState {
+    std::vector<std::unique_ptr<DirRecord>> dirs;
+    std::vector<CoverageReport::Pattern> patterns;
+    std::vector<CoverageReport::Item> top_files;  // min-heap on bytes
+    std::string path;
+    std::uint64_t files = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t ignored_files = 0;
+    std::uint64_t ignored_bytes = 0;
+};
+
+bool smaller_first(const CoverageReport::Item& a, const CoverageReport::Item& b) {
+    return a.bytes > b.bytes;
+}
+
+bool larger_first(const CoverageReport::Item& a, const CoverageReport::Item& b) {
+    return a.bytes != b.bytes ? a.bytes > b.bytes : a.path < b.path;
+}
+
+// Keeps the `top` largest items in a min-heap.
+void offer(std::vector<CoverageReport::Item>& heap, std::size_t top, CoverageReport::Item item) {
+    if (top == 0) return;
+    if (heap.size() == top) {
+        if (item.bytes <= heap.front().bytes) return;
+        std::pop_heap(heap.begin(), heap.end(), smaller_first);
+        heap.pop_back();
+    }
+    heap.push_back(std::move(item));
+    std::push_heap(heap.begin(), heap.end(), smaller_first);
+}
+
+// Paths tracked in the work tree at root, relative to it, from
+// `git ls-files -z`. Returns false if root is not in a work tree or git is
+// not available.
+bool tracked_files(const std::filesystem::path& root, std::unordered_set<std::string>& out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        if (int null = open("/dev/null", O_WRONLY); null >= 0) dup2(null, STDERR_FILENO);
+        execlp("git", "git", "-C", root.c_str(), "ls-files", "-z", static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    close(fds[1]);
+
+    std::string data;
+    char buf[1 << 16];
+    for (;;) {
+        auto n = read(fds[0], buf, sizeof buf);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        data.append(buf, n);
+    }
+    close(fds[0]);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return false;
+
+    std::size_t start = 0;
+    for (std::size_t end; (end = data.find('\0', start)) != std::string::npos; start = end + 1)
+        out.emplace(data, start, end - start);
+    return true;
+}
+
+} // namespace
+
+Coverage::Coverage(const IgnoreMatcher& matcher, CoverageOptions opts)
+    : matcher(matcher), opts(opts) {}
+
+CoverageReport Coverage::run(const std::filesystem::path& root) const {
+    CoverageReport report;
+    std::unordered_set<std::string> tracked;
+    report.tracked_known = tracked_files(root, tracked);
+
+    WalkOptions wopts;
+    wopts.threads = opts.threads;
+    wopts.max_depth = -1;
+    wopts.skip_hidden = false;
+    wopts.stat_files = true;
+    Walker walker(wopts);
+
+    std::vector<WorkerState> workers(walker.thread_count());
+    for (auto& w : workers) w.patterns.resize(matcher.size());
+    DirRecord top{"", nullptr, 0, -1};
+
+    walker.walk(root, [&](unsigned worker, const Walker::Entry& e) {
+        if (e.is_dir && e.name == ".git") return false;
+        auto& w = workers[worker];
+        auto* parent = reinterpret_cast<DirRecord*>(e.tag);
+        w.path.assign(e.dir);
+        if (!w.path.empty()) w.path += '/';
+        w.path += e.name;
+
+        // Below an excluded directory the directory's rule decides.
+        int rule = parent->excluded;
+        bool inherited = rule >= 0;
+        if (!inherited) rule = matcher.match(w.path, e.is_dir);
+
+        if (e.is_dir) {
+            if (!inherited && rule >= 0) w.patterns[rule].dirs++;
+            auto d = std::make_unique<DirRecord>(DirRecord{w.path, parent, e.depth + 1,
+                                                           matcher.ignores(rule) ? rule : -1});
+            e.tag = reinterpret_cast<std::uintptr_t>(d.get());
+            w.dirs.push_back(std::move(d));
+            return true;
+        }
+
+        w.files++;
+        w.bytes += e.size;
+        if (rule >= 0) {
+            w.patterns[rule].files++;
+            w.patterns[rule].bytes += e.size;
+        }
+        // Only the worker reading a directory updates its record.
+        bool is_tracked = report.tracked_known && tracked.count(w.path);
+        if (is_tracked) parent->tracked = true;
+        if (matcher.ignores(rule)) {
+            w.ignored_files++;
+            w.ignored_bytes += e.size;
+        } else if (!is_tracked) {
+            parent->bytes += e.size;
+            parent->files++;
+            if (e.size) offer(w.top_files, opts.top, {w.path, e.size, 1});
+        }
+        return true;
+    }, reinterpret_cast<std::uintptr_t>(&top));
+
+    report.patterns.resize(matcher.size());
+    std::vector<DirRecord*> dirs;
+    std::vector<CoverageReport::Item> top_files;
+    for (auto& w : workers) {
+        for (std::size_t i = 0; i < w.patterns.size(); i++) {
+            report.patterns[i].files += w.patterns[i].files;
+            report.patterns[i].bytes += w.patterns[i].bytes;
+            report.patterns[i].dirs += w.patterns[i].dirs;
+        }
+        report.files += w.files;
+        report.bytes += w.bytes;
+        report.ignored_files += w.ignored_files;
+        report.ignored_bytes += w.ignored_bytes;
+        for (auto& item : w.top_files) offer(top_files, opts.top, std::move(item));
+        for (auto& d : w.dirs) dirs.push_back(d.get());
+    }
+    std::sort(top_files.begin(), top_files.end(), larger_first);
+    report.largest_files = std::move(top_files);
+
+    // Sum up the tree, deepest first, then report the directories git status
+    // would list as untracked: no tracked file below, and the parent has one
+    // (or is the root).
+    std::sort(dirs.begin(), dirs.end(), [](const DirRecord* a, const DirRecord* b) { return a->depth > b->depth; });
+    for (auto* d : dirs) {
+        d->parent->bytes += d->bytes;
+        d->parent->files += d->files;
+        d->parent->tracked |= d->tracked;
+    }
+    std::vector<CoverageReport::Item> top_dirs;
+    for (const auto* d : dirs) {
+        if (d->excluded >= 0 || d->tracked || d->bytes == 0) continue;
+        if (d->parent != &top && !d->parent->tracked) continue;
+        offer(top_dirs, opts.top, {d->path + "/", d->bytes, d->files});
+    }
+    std::sort(top_dirs.begin(), top_dirs.end(), larger_first);
+    report.largest_dirs = std::move(top_dirs);
+    return report;
+}
@@ -0,0 +1,120 @@
+#include "DetectMatcher.hpp"
+#include "Stats.hpp"
+
+#include <fnmatch.h>
+#include <sstream>
+
+namespace {
+
+std::string fold(std::string_view s) {
+    std::string out(s);
+    for (auto& c : out)
+        if (c >= 'A' && c <= 'Z') c = char(c - 'A' + 'a');
+    return out;
+}
+
+bool has_wildcard(std::string_view s) {
+    return s.find_first_of("*?[\\") != std::string_view::npos;
+}
+
+void add(std::vector<std::uint32_t>& list, std::uint32_t t) {
+    if (list.empty() || list.back() != t) list.push_back(t);
+}
+
+} // namespace
+
+DetectMatcher::DetectMatcher(const std::vector<TemplateStore::Template>& templates, const StringPool& strings)
+    : reachable(templates.size(), 0), count(templates.size())
+{
+    StatsPhase phase("detect.compile");
+    // What a pattern compiles to, by interned id: the lists (in stable
+    // unordered_map nodes) that its templates go on, or a glob.
+    struct Compiled {
+        bool done = false;
+        bool reachable = false;
+        bool glob = false;
+        std::vector<std::uint32_t>* lists[2] = {nullptr, nullptr};
+    };
+    std::vector<Compiled> compiled(strings.size());
+    for (std::uint32_t i = 0; i < templates.size(); i++) {
+        for (auto id : templates[i].detect_patterns) {
+            auto& c = compiled[id];
+            std::string_view p = strings[id];
+            if (!c.done) {
+                c.done = true;
+                c.reachable = !p.starts_with('.') && p.find('/') == std::string_view::npos;
+                if (p.starts_with("*.") && !has_wildcard(p.substr(2))) {
+                    c.lists[0] = &extensions[fold(p.substr(2))];
+                } else if (!has_wildcard(p)) {
+                    auto key = fold(p);
+                    // The old detector also tried "x" + extension against every
+                    // pattern, so an exact "x.ext" behaves like "*.ext".
+                    if (key.size() > 1 && key[0] == 'x' && key[1] == '.' &&
+                        key.find('.', 2) == std::string::npos)
+                        c.lists[1] = &extensions[key.substr(2)];
+                    c.lists[0] = &exact[std::move(key)];
+                } else {
+                    c.glob = true;
+                }
+            }
+            if (c.reachable) reachable[i] = 1;
+            for (auto* list : c.lists)
+                if (list) add(*list, i);
+            if (c.glob) globs.push_back({std::string(p), i});
+        }
+
+        for (auto id : templates[i].content_rules) {
+            std::istringstream ss{std::string(strings[id])};
+            std::string file, text;
+            ss >> file;
+            std::getline(ss >> std::ws, text);
+            if (file.empty() || text.empty() || text == "^") continue;
+
+            auto r = std::uint32_t(content_rules.size());
+            bool anchored = text[0] == '^';
+            content_rules.push_back({i, anchored ? text.substr(1) : text, anchored});
+            if (file == "(noext)") {
+                content_noext.push_back(r);
+            } else if (!has_wildcard(file)) {
+                content_exact[fold(file)].push_back(r);
+            } else {
+                content_globs.push_back({file, r});
+            }
+            if (!file.starts_with('.') && file.find('/') == std::string::npos) reachable[i] = 1;
+        }
+    }
+}
+
+void DetectMatcher::match_content(std::string_view name, std::vector<std::uint32_t>& out) const {
+    if (name.empty() || name.size() >= max_name) return;
+    if (!content_exact.empty()) {
+        char folded[max_name];
+        for (std::size_t i = 0; i < name.size(); i++) {
+            char c = name[i];
+            folded[i] = (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+        }
+        if (auto it = content_exact.find(std::string_view(folded, name.size())); it != content_exact.end())
+            out.insert(out.end(), it->second.begin(), it->second.end());
+    }
+    if (name.find('.') == std::string_view::npos)
+        out.insert(out.end(), content_noext.begin(), content_noext.end());
+    if (!content_globs.empty()) {
+        char buf[max_name + 1];
+        name.copy(buf, name.size());
+        buf[name.size()] = '\0';
+        for (const auto& g : content_globs)
+            if (fnmatch(g.pattern.c_str(), buf, FNM_CASEFOLD) == 0) out.push_back(g.tmpl);
+    }
+}
+
+bool DetectMatcher::glob_matches(const Glob& g, std::string_view name, std::string_view ext) const {
+    char buf[max_name + 1];
+    name.copy(buf, name.size());
+    buf[name.size()] = '\0';
+    if (fnmatch(g.pattern.c_str(), buf, FNM_CASEFOLD) == 0) return true;
+    if (ext.empty()) return false;
+    buf[0] = 'x';
+    ext.copy(buf + 1, ext.size());
+    buf[ext.size() + 1] = '\0';
+    return fnmatch(g.pattern.c_str(), buf, FNM_CASEFOLD) == 0;
+}
@@ -1,60 +1,142 @@
 #include "Detector.hpp"
+#include "EmbeddedTemplates.hpp"
+#include "PrefixReader.hpp"
+#include "Stats.hpp"
+#include "Walker.hpp"
 
-#include <algorithm>
-#include <fnmatch.h>
-#include <unordered_set>
+#include <atomic>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace fs = std::filesystem;
 
-Detector::Detector(TemplateStore& store) : store(store) {}
+namespace {
 
-bool Detector::pattern_matches(const std::string& name, const std::string& pattern) {
-    return fnmatch(pattern.c_str(), name.c_str(), FNM_CASEFOLD) == 0;
-}
+constexpr std::size_t clock_check_interval = 64;
 
-std::vector<std::string> Detector::detect(const fs::path& dir) {
-    std::unordered_set<std::string> filenames;
-    std::unordered_set<std::string> extensions;
+// A file selected by content rules, with the rules that selected it.
+struct Candidate {
+    std::string path;  // relative to the detection root
+    std::vector<std::uint32_t> rules;
+};
 
-    auto collect = [&](const fs::path& p) {
-        auto fname = p.filename().string();
-        if (!fname.empty() && fname[0] != '.') {
-            filenames.insert(fname);
-            if (p.has_extension()) extensions.insert(p.extension().string());
-        }
-    };
+struct WorkerState {
+    std::vector<Candidate> candidates;
+    std::vector<std::uint32_t> rules;  // scratch
+};
 
-    try {
-        for (auto it = fs::recursive_directory_iterator(dir); it != fs::recursive_directory_iterator{}; ++it) {
-            auto fname = it->path().filename().string();
-            if (!fname.empty() && fname[0] == '.') {
-                if (fs::is_directory(it->path())) it.disable_recursion_pending();
-                continue;
-            }
-            if (it.depth() > 3) { it.disable_recursion_pending(); continue; }
-            collect(it->path());
-        }
-    } catch (...) {}
+} // namespace
+
+Detector::Detector(TemplateStore& store, DetectOptions opts)
+    : templates(store.all()), opts(opts), matcher(templates, store.strings()) {}
+
+DetectResult Detector::detect(const fs::path& dir, const DetectOptions& opts) const {
+    StatsPhase phase("detect");
+    const auto& m = matcher;
+
+    std::vector<std::atomic<std::uint64_t>> matched((templates.size() + 63) / 64);
+    std::atomic<std::size_t> remaining{0};
+    for (std::uint32_t i = 0; i < templates.size(); i++)
+        if (m.matchable(i)) remaining++;
+
+    DetectResult result;
+    if (remaining == 0) return result;
+
+    WalkOptions wopts;
+    wopts.threads = opts.threads;
+    wopts.gitignore = opts.gitignore;
+    wopts.prune = opts.prune;
+    if (opts.prune_defaults)
+        for (auto name : default_prune_dirs()) wopts.prune.emplace_back(name);
+    Walker walker(std::move(wopts));
 
-    std::unordered_set<std::string> suggested;
+    std::atomic<std::size_t> entries{0};
+    std::atomic<bool> partial{false};
+    auto deadline = std::chrono::steady_clock::now() + opts.time_budget;
 
-    for (const auto& tmpl : store.all()) {
-        if (tmpl.detect_patterns.empty()) continue;
-        for (const auto& pattern : tmpl.detect_patterns) {
-            bool matched = false;
-            for (const auto& fname : filenames) {
-                if (pattern_matches(fname, pattern)) { matched = true; break; }
+    auto is_marked = [&](std::uint32_t t) {
+        return (matched[t / 64].load(std::memory_order_relaxed) >> (t % 64)) & 1;
+    };
+    auto mark = [&](std::uint32_t t) {
+        auto& word = matched[t / 64];
+        std::uint64_t bit = std::uint64_t(1) << (t % 64);
+        if (word.load(std::memory_order_relaxed) & bit) return;
+        if (word.fetch_or(bit, std::memory_order_relaxed) & bit) return;
+        if (m.matchable(t) && remaining.fetch_sub(1, std::memory_order_relaxed) == 1) walker.stop();
+    };
+
+    // Content rules only collect candidates during the walk; their files are
+    // read in one batch once the walk is over.
+    std::vector<WorkerState> workers(m.has_content_rules() ? walker.thread_count() : 0);
+    std::atomic<std::size_t> candidates{0};
+
+    {
+        StatsPhase walk_phase("detect.walk");
+        walker.walk(dir, [&](unsigned worker, const Walker::Entry& e) {
+            std::size_t n = entries.fetch_add(1, std::memory_order_relaxed) + 1;
+            if (opts.max_entries && n > opts.max_entries) {
+                partial = true;
+                walker.stop();
+                return false;
+            }
+            if (opts.time_budget.count() && n % clock_check_interval == 0 &&
+                std::chrono::steady_clock::now() >= deadline) {
+                partial = true;
+                walker.stop();
             }
-            if (!matched) {
-                for (const auto& ext : extensions) {
-                    if (pattern_matches("x" + ext, pattern)) { matched = true; break; }
+            m.match(e.name, mark);
+            if (!e.is_dir && !workers.empty()) {
+                auto& w = workers[worker];
+                w.rules.clear();
+                m.match_content(e.name, w.rules);
+                std::erase_if(w.rules, [&](std::uint32_t r) { return is_marked(m.content_rule(r).tmpl); });
+                if (!w.rules.empty() && candidates.fetch_add(1, std::memory_order_relaxed) < max_content_candidates) {
+                    std::string path(e.dir);
+                    if (!path.empty()) path += '/';
+                    path += e.name;
+                    w.candidates.push_back({std::move(path), w.rules});
                 }
             }
-            if (matched) { suggested.insert(tmpl.name); break; }
+            return true;
+        });
+    }
+    std::size_t visited = entries.load();
+    if (opts.max_entries && visited > opts.max_entries) visited = opts.max_entries;
+    Stats::count(Stats::matcher_calls, visited);
+    Stats::count(Stats::glob_checks, visited * m.glob_count());
+
+    bool out_of_time = opts.time_budget.count() && std::chrono::steady_clock::now() >= deadline;
+    if (remaining > 0 && !workers.empty() && !out_of_time) {
+        StatsPhase content_phase("detect.content");
+        std::vector<Candidate> todo;
+        for (auto& w : workers)
+            for (auto& c : w.candidates) {
+                std::erase_if(c.rules, [&](std::uint32_t r) { return is_marked(m.content_rule(r).tmpl); });
+                if (!c.rules.empty()) todo.push_back(std::move(c));
+            }
+        std::vector<std::string> paths;
+        for (auto& c : todo) paths.push_back(std::move(c.path));
+
+        int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd >= 0) {
+            PrefixReader reader(content_prefix, walker.thread_count());
+            reader.read(dir_fd, paths, [&](std::size_t i, std::string_view prefix) {
+                Stats::count(Stats::content_files_read);
+                Stats::count(Stats::bytes_read, prefix.size());
+                for (auto r : todo[i].rules) {
+                    const auto& rule = m.content_rule(r);
+                    if (!is_marked(rule.tmpl) && rule.matches(prefix)) mark(rule.tmpl);
+                }
+            });
+            close(dir_fd);
         }
     }
 
-    std::vector<std::string> result(suggested.begin(), suggested.end());
-    std::sort(result.begin(), result.end());
+    result.partial = partial && remaining > 0;
+    result.entries = visited;
+    for (std::size_t i = 0; i < templates.size(); i++)
+        if (matched[i / 64].load(std::memory_order_relaxed) & (std::uint64_t(1) << (i % 64)))
+            result.templates.emplace_back(templates[i].name);
     return result;
 }
@@ -0,0 +1,655 @@
+#include "Generator.hpp"
+#include "Common.hpp"
+#include "PatternDedup.hpp"
+#include "Stats.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <fstream>
+#include <iterator>
+#include <unordered_set>
+#include <utility>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+// Bodies at least this large are copied in the kernel when possible.
+constexpr std::size_t copy_range_threshold = 1 << 20;
+
+// Collects output pieces and writes them with as few syscalls as possible.
+class Output {
+public:
+    explicit Output(int fd, bool allow_copy_range) : fd(fd), allow_copy_range(allow_copy_range) {}
+
+    // For output queued before the file is opened.
+    void set_fd(int f) { fd = f; }
+    // Position to rewind() to, dropping what was queued after it.
+    std::size_t mark() const { return iov.size(); }
+    void rewind(std::size_t m) { iov.resize(m); }
+
+    void text(std::string s) {
+        owned.push_back(std::move(s));
+        view(owned.back());
+    }
+
+    void view(std::string_view v) {
+        if (!v.empty()) iov.push_back({const_cast<char*>(v.data()), v.size()});
+    }
+
+    void body(const TemplateStore::Body& b) {
+#ifdef __linux__
+        if (allow_copy_range && b.fd() >= 0 && b.view().size() >= copy_range_threshold) {
+            if (!flush()) return;
+            loff_t off = 0;
+            const loff_t len = b.view().size();
+            while (off < len) {
+                auto n = copy_file_range(b.fd(), &off, fd, nullptr, len - off, 0);
+                if (n > 0) Stats::count(Stats::bytes_written, n);
+                if (n > 0 || (n < 0 && errno == EINTR)) continue;
+                if (n < 0 && off == 0 && (errno == EXDEV || errno == EINVAL ||
+                                          errno == ENOSYS || errno == EOPNOTSUPP)) {
+                    // Not supported between these files; write from the map.
+                    allow_copy_range = false;
+                    view(b.view());
+                    return;
+                }
+                failed = true;
+                return;
+            }
+            return;
+        }
+#endif
+        view(b.view());
+    }
+
+    bool flush() {
+        std::size_t i = 0;
+        while (!failed && i < iov.size()) {
+            int count = (int)std::min<std::size_t>(iov.size() - i, IOV_MAX);
+            auto n = writev(fd, iov.data() + i, count);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                failed = true;
+                break;
+            }
+            Stats::count(Stats::bytes_written, n);
+            std::size_t left = n;
+            while (left > 0 && left >= iov[i].iov_len) left -= iov[i++].iov_len;
+            if (left > 0) {
+                iov[i].iov_base = static_cast<char*>(iov[i].iov_base) + left;
+                iov[i].iov_len -= left;
+            }
+        }
+        iov.clear();
+        owned.clear();
+        return !failed;
+    }
+
+private:
+    int fd;
+    bool allow_copy_range;
+    bool failed = false;
+    std::vector<iovec> iov;
+    std::deque<std::string> owned;  // stable storage for generated headers
+};
+
+constexpr std::string_view generated_line = "# Generated by autoignore";
+constexpr std::string_view merged_suffix = " --merge";
+constexpr std::string_view templates_prefix = "# Templates:";
+constexpr std::string_view hashes_prefix = "# Hashes:";
+
+std::string format_stamp(const Stamp& stamp) {
+    std::string out(generated_line);
+    if (stamp.merged) out += merged_suffix;
+    out += '\n';
+    out += templates_prefix;
+    for (const auto& name : stamp.templates) out += " " + name;
+    out += '\n';
+    out += hashes_prefix;
+    char hex[17];
+    for (auto h : stamp.hashes) {
+        std::snprintf(hex, sizeof hex, "%016llx", (unsigned long long)h);
+        out += ' ';
+        out += hex;
+    }
+    out += "\n\n";
+    return out;
+}
+
+std::vector<std::string_view> split_words(std::string_view s) {
+    std::vector<std::string_view> words;
+    for (std::size_t pos = 0; pos < s.size();) {
+        auto start = s.find_first_not_of(' ', pos);
+        if (start == std::string_view::npos) break;
+        auto end = std::min(s.find(' ', start), s.size());
+        words.push_back(s.substr(start, end - start));
+        pos = end;
+    }
+    return words;
+}
+
+// Parses the header at the start of `text`; `end` is set to where the first
+// section starts.
+bool parse_stamp(std::string_view text, Stamp& stamp, std::size_t& end) {
+    auto next_line = [&](std::size_t& pos) {
+        auto nl = text.find('\n', pos);
+        auto line = text.substr(pos, nl == std::string_view::npos ? std::string_view::npos : nl - pos);
+        pos = nl == std::string_view::npos ? text.size() : nl + 1;
+        if (line.ends_with('\r')) line.remove_suffix(1);
+        return line;
+    };
+    std::size_t pos = 0;
+    auto first = next_line(pos);
+    if (!first.starts_with(generated_line)) return false;
+    first.remove_prefix(generated_line.size());
+    if (!first.empty() && first != merged_suffix) return false;
+    stamp = Stamp{};
+    stamp.merged = !first.empty();
+
+    auto names = next_line(pos);
+    if (!names.starts_with(templates_prefix)) return false;
+    for (auto name : split_words(names.substr(templates_prefix.size()))) stamp.templates.emplace_back(name);
+
+    std::size_t after = pos;
+    auto hashes = next_line(after);
+    if (hashes.starts_with(hashes_prefix)) {
+        pos = after;
+        for (auto word : split_words(hashes.substr(hashes_prefix.size()))) {
+            std::string hex(word);
+            char* stop = nullptr;
+            stamp.hashes.push_back(std::strtoull(hex.c_str(), &stop, 16));
+            if (hex.empty() || *stop) stamp.hashes.clear();
+        }
+        if (stamp.hashes.size() != stamp.templates.size()) stamp.hashes.clear();
+    }
+    after = pos;
+    if (next_line(after).empty()) pos = after;
+    end = pos;
+    return true;
+}
+
+// Writes `file` by way of a temporary next to it and a rename, keeping its
+// permissions. A symlink is followed, so the rename replaces its target and
+// the link stays. `write` fills the temporary, given its path.
+bool replace_file(const std::filesystem::path& link, const std::function<bool(const std::filesystem::path&)>& write) {
+    char resolved[PATH_MAX];
+    std::filesystem::path file = realpath(link.c_str(), resolved) ? std::filesystem::path(resolved) : link;
+    struct stat st;
+    mode_t mode = stat(file.c_str(), &st) == 0 ? st.st_mode & 07777 : 0644;
+    auto tmp = file;
+    tmp += ".tmp." + std::to_string(getpid());
+    bool ok = write(tmp) && chmod(tmp.c_str(), mode) == 0 && rename(tmp.c_str(), file.c_str()) == 0;
+    if (!ok) unlink(tmp.c_str());
+    return ok;
+}
+
+// Queues the lines of body that dedup admits, coalescing consecutive kept
+// lines into one view. Comments and blank lines are always kept. Returns the
+// number of pattern lines kept.
+std::size_t merge_body(Output& out, std::string_view body, std::uint32_t origin, PatternDedup& dedup,
+                       const std::vector<std::string>& names, std::vector<DroppedPattern>& dropped)
+{
+    std::size_t kept = 0;
+    std::size_t run = 0;
+    std::size_t pos = 0;
+    while (pos < body.size()) {
+        auto nl = body.find('\n', pos);
+        std::size_t end = nl == std::string_view::npos ? body.size() : nl + 1;
+        auto line = body.substr(pos, end - pos);
+        if (line.ends_with('\n')) line.remove_suffix(1);
+        std::uint32_t first = 0;
+        if (!dedup.admit(line, origin, &first)) {
+            out.view(body.substr(run, pos - run));
+            run = end;
+            dropped.push_back({std::string(PatternDedup::normalize(line)), names[origin], names[first]});
+        } else if (!PatternDedup::normalize(line).empty()) {
+            kept++;
+        }
+        pos = end;
+    }
+    out.view(body.substr(run));
+    return kept;
+}
+
+std::string read_file(const std::filesystem::path& file) {
+    std::ifstream in(file, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+// --append to a file that has content: adds only what it lacks. Templates
+// named in one of its autoignore headers are left out whole; the lines of
+// the others are checked against every line of the file, and each other, as
+// --merge does, so a pattern is only dropped when nothing after it in the
+// file could change its effect. The result replaces the file atomically;
+// nothing is written if there is nothing to add.
+GenerateResult append_missing(const std::filesystem::path& file, std::string_view existing,
+                              const std::vector<std::pair<std::string, TemplateStore::Body>>& bodies,
+                              const Stamp& requested, GenerateResult result)
+{
+    PatternDedup dedup;
+    std::unordered_set<std::string_view> present;
+    std::string_view previous;
+    for (std::size_t pos = 0; pos < existing.size();) {
+        auto nl = existing.find('\n', pos);
+        auto line = existing.substr(pos, nl == std::string_view::npos ? std::string_view::npos : nl - pos);
+        pos = nl == std::string_view::npos ? existing.size() : nl + 1;
+        dedup.admit(line, 0);
+        if (previous.starts_with(generated_line) && line.starts_with(templates_prefix))
+            for (auto name : split_words(line.substr(templates_prefix.size()))) present.insert(name);
+        previous = line;
+    }
+
+    // Origin 0 is the file itself.
+    std::vector<std::string> labels{file.filename().string()};
+    for (const auto& [name, _] : bodies) labels.push_back(name);
+
+    Stamp added;
+    added.merged = true;
+    result.templates.clear();
+    Output sections(-1, false);
+    for (std::uint32_t i = 0; i < bodies.size(); i++) {
+        const auto& [name, body] = bodies[i];
+        if (present.count(name)) {
+            result.present.push_back(name);
+            continue;
+        }
+        auto mark = sections.mark();
+        sections.text("# " + name + "\n");
+        if (merge_body(sections, body.view(), i + 1, dedup, labels, result.dropped) == 0) {
+            // Every pattern is in the file already.
+            sections.rewind(mark);
+            result.present.push_back(name);
+            continue;
+        }
+        sections.view(body.view().ends_with('\n') ? "\n" : "\n\n");
+        added.templates.push_back(name);
+        added.hashes.push_back(requested.hashes[i]);
+        result.templates.push_back(name);
+    }
+    if (added.templates.empty()) return result;
+
+    bool ok = replace_file(file, [&](const std::filesystem::path& tmp) {
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0) return false;
+        Output head(fd, false);
+        head.view(existing);
+        if (!existing.ends_with('\n')) head.view("\n");
+        if (!existing.ends_with("\n\n")) head.view("\n");
+        head.text(format_stamp(added));
+        sections.set_fd(fd);
+        bool written = head.flush() && sections.flush();
+        return close(fd) == 0 && written;
+    });
+    if (!ok) result.error = "cannot write " + file.string();
+    return result;
+}
+
+// Where the "# name" line of a section starts in `block`, at or after
+// `from`; npos if there is none. A line that follows a blank one, as
+// generate() writes them, is preferred over a comment of that text inside
+// the section before.
+std::size_t find_heading(std::string_view block, std::string_view heading, std::size_t from) {
+    for (bool after_blank : {true, false}) {
+        for (auto pos = block.find(heading, from); pos != std::string_view::npos; pos = block.find(heading, pos + 1)) {
+            auto end = pos + heading.size();
+            bool line = (pos == 0 || block[pos - 1] == '\n') &&
+                        (end == block.size() || block[end] == '\n' || block[end] == '\r');
+            if (line && (!after_blank || pos == 0 || (pos >= 2 && block[pos - 2] == '\n'))) return pos;
+        }
+    }
+    return std::string_view::npos;
+}
+
+// Skips the blank line generate() writes after a section's body, ending
+// the body's last line first if it had no newline.
+std::size_t skip_separator(std::string_view body, std::size_t pos) {
+    if (pos > 0 && body[pos - 1] != '\n' && pos < body.size() && body[pos] == '\n') pos++;
+    if (pos < body.size() && body[pos] == '\n') pos++;
+    return pos;
+}
+
+// The end of a section's rendered text in `body`, the text after its
+// "# name" line, separator included: the prefix whose hash is `hash`, as
+// written for a template without --merge. npos if no prefix has it.
+std::size_t hashed_extent(std::string_view body, std::uint64_t hash) {
+    auto h = TemplateStore::content_hash({});
+    for (std::size_t pos = 0;;) {
+        if (h == hash) return skip_separator(body, pos);
+        if (pos == body.size()) return std::string_view::npos;
+        auto nl = std::min(body.find('\n', pos), body.size());
+        h = TemplateStore::content_hash(body.substr(pos, nl - pos), h);
+        pos = nl;
+        if (h == hash) return skip_separator(body, pos);
+        if (pos == body.size()) return std::string_view::npos;
+        h = TemplateStore::content_hash("\n", h);
+        pos++;
+    }
+}
+
+// The same for a section rendered with --merge from `content`, unchanged
+// since: its lines are those of `content` in order, some left out. Lines
+// after the last one that fits were added by hand.
+std::size_t merged_extent(std::string_view body, std::string_view content) {
+    std::size_t pos = 0;
+    for (std::size_t at = 0; pos < body.size();) {
+        auto nl = std::min(body.find('\n', pos), body.size());
+        auto line = body.substr(pos, nl - pos);
+        auto next = std::string_view::npos;
+        while (at < content.size()) {
+            auto end = std::min(content.find('\n', at), content.size());
+            bool same = content.substr(at, end - at) == line;
+            at = std::min(end + 1, content.size());
+            if (same) {
+                next = at;
+                break;
+            }
+        }
+        if (next == std::string_view::npos) break;
+        pos = std::min(nl + 1, body.size());
+    }
+    // The separator may have been taken for a blank line of the template.
+    if (pos >= 2 && body[pos - 1] == '\n' && body[pos - 2] == '\n') return pos;
+    return skip_separator(body, pos);
+}
+
+} // namespace
+
+Generator::Generator(TemplateStore& store) : store(store) {}
+
+GenerateResult Generator::generate(const std::vector<std::string>& names,
+                                   const GenerateOptions& opts)
+{
+    StatsPhase phase("generate");
+    GenerateResult result;
+    std::vector<std::pair<std::string, TemplateStore::Body>> bodies;
+    Stamp stamp;
+    stamp.merged = opts.merge;
+    {
+        StatsPhase open_phase("generate.open");
+        for (const auto& name : names) {
+            const auto* t = store.find(name);
+            if (!t) {
+                result.missing.push_back(name);
+                continue;
+            }
+            bodies.emplace_back(name, store.open_content(*t));
+            stamp.templates.push_back(name);
+            stamp.hashes.push_back(store.current_hash(*t, &bodies.back().second));
+        }
+    }
+
+    if (bodies.empty()) {
+        result.error = "no valid templates";
+        return result;
+    }
+
+    for (const auto& [name, _] : bodies) result.templates.push_back(name);
+    PatternDedup dedup;
+
+    if (opts.append && !opts.preview) {
+        auto existing = read_file(opts.output);
+        if (!existing.empty()) return append_missing(opts.output, existing, bodies, stamp, std::move(result));
+    }
+
+    if (opts.preview) {
+        Output out(opts.preview_fd, false);
+        for (std::uint32_t i = 0; i < bodies.size(); i++) {
+            const auto& [name, body] = bodies[i];
+            out.text(color::bold + color::cyan + "# " + name + color::reset + "\n");
+            if (opts.merge) merge_body(out, body.view(), i, dedup, result.templates, result.dropped);
+            else out.view(body.view());
+            out.view(body.view().ends_with('\n') ? "\n" : "\n\n");
+        }
+        StatsPhase write_phase("generate.write");
+        if (!out.flush()) result.error = "cannot write preview";
+        return result;
+    }
+
+    int fd = open(opts.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        result.error = "cannot open " + opts.output.string();
+        return result;
+    }
+    struct stat st;
+    bool copy_range = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+
+    Output out(fd, copy_range);
+    out.text(format_stamp(stamp));
+
+    for (std::uint32_t i = 0; i < bodies.size(); i++) {
+        const auto& [name, body] = bodies[i];
+        out.text("# " + name + "\n");
+        if (opts.merge) merge_body(out, body.view(), i, dedup, result.templates, result.dropped);
+        else out.body(body);
+        out.view(body.view().ends_with('\n') ? "\n" : "\n\n");
+    }
+
+    StatsPhase write_phase("generate.write");
+    bool ok = out.flush();
+    if (close(fd) != 0) ok = false;
+    if (!ok) result.error = "cannot write " + opts.output.string();
+    return result;
+}
+
+std::vector<Generator::Block> Generator::parse_blocks(std::string_view text) {
+    std::vector<Block> blocks;
+    for (std::size_t pos = 0; pos < text.size();) {
+        Block b;
+        std::size_t end;
+        if (text.substr(pos).starts_with(generated_line) && parse_stamp(text.substr(pos), b.stamp, end)) {
+            if (!blocks.empty()) blocks.back().end = pos;
+            b.start = pos;
+            b.body = pos = pos + end;
+            blocks.push_back(std::move(b));
+            continue;
+        }
+        auto nl = text.find('\n', pos);
+        pos = nl == std::string_view::npos ? text.size() : nl + 1;
+    }
+    if (!blocks.empty()) blocks.back().end = text.size();
+    return blocks;
+}
+
+std::string_view Generator::hand_written(std::string_view text) {
+    auto blocks = parse_blocks(text);
+    return blocks.empty() ? text : text.substr(0, blocks.front().start);
+}
+
+CheckResult Generator::check(const std::filesystem::path& file) {
+    CheckResult result;
+    if (access(file.c_str(), R_OK) != 0) {
+        result.error = "cannot read " + file.string();
+        return result;
+    }
+    auto text = read_file(file);
+    auto blocks = parse_blocks(text);
+    if (blocks.empty()) result.error = "not generated by autoignore: " + file.string();
+    for (const auto& b : blocks) {
+        auto r = compare(b.stamp);
+        result.changed.insert(result.changed.end(), r.changed.begin(), r.changed.end());
+        result.missing.insert(result.missing.end(), r.missing.begin(), r.missing.end());
+    }
+    return result;
+}
+
+CheckResult Generator::compare(const Stamp& stamp) {
+    CheckResult result;
+    for (std::size_t i = 0; i < stamp.templates.size(); i++) {
+        const auto* t = store.find(stamp.templates[i]);
+        if (!t) result.missing.push_back(stamp.templates[i]);
+        else if (stamp.hashes.empty() || stamp.hashes[i] != store.current_hash(*t))
+            result.changed.push_back(stamp.templates[i]);
+    }
+    return result;
+}
+
+GenerateResult Generator::update(const std::filesystem::path& file) {
+    GenerateResult result;
+    if (access(file.c_str(), R_OK) != 0) {
+        result.error = "cannot read " + file.string();
+        return result;
+    }
+    auto text = read_file(file);
+    auto blocks = parse_blocks(text);
+    if (blocks.empty()) {
+        result.error = "not generated by autoignore: " + file.string();
+        return result;
+    }
+
+    std::vector<CheckResult> checks;
+    bool changed = false;
+    for (const auto& b : blocks) {
+        checks.push_back(compare(b.stamp));
+        result.missing.insert(result.missing.end(), checks.back().missing.begin(), checks.back().missing.end());
+        changed = changed || !checks.back().changed.empty();
+    }
+    // Missing templates alone leave their sections as they are.
+    if (!changed) return result;
+
+    // Everything written so far is fed to `dedup`, so a merged section
+    // renders again as --merge and --append would have: without what the
+    // file has before it. Origin 0 is text outside the sections.
+    PatternDedup dedup;
+    std::vector<std::string> labels{file.filename().string()};
+    auto feed = [&](std::string_view part, std::uint32_t origin) {
+        for (std::size_t pos = 0; pos < part.size();) {
+            auto nl = part.find('\n', pos);
+            dedup.admit(part.substr(pos, nl == std::string_view::npos ? std::string_view::npos : nl - pos), origin);
+            pos = nl == std::string_view::npos ? part.size() : nl + 1;
+        }
+    };
+
+    std::deque<TemplateStore::Body> bodies;
+    Output out(-1, false);
+    auto before = std::string_view(text).substr(0, blocks.front().start);
+    out.view(before);
+    feed(before, 0);
+    // Set once a section renders differently: merged sections after it were
+    // deduplicated against text that is gone, and render again too.
+    bool shifted = false;
+    for (std::size_t k = 0; k < blocks.size(); k++) {
+        const auto& b = blocks[k];
+        const auto& check = checks[k];
+        auto block_text = std::string_view(text).substr(b.start, b.end - b.start);
+        if (check.changed.empty() && !(shifted && b.stamp.merged)) {
+            out.view(block_text);
+            feed(block_text, 0);
+            continue;
+        }
+
+        // Sections run from their "# name" line to the next one, so lines
+        // added by hand go with the section above them; text before the
+        // first one is kept as it is.
+        const auto& names = b.stamp.templates;
+        auto block = std::string_view(text).substr(b.body, b.end - b.body);
+        std::vector<std::size_t> starts;
+        for (std::size_t i = 0, pos = 0; i < names.size(); i++) {
+            pos = find_heading(block, "# " + names[i], pos);
+            if (pos == std::string_view::npos) {
+                result.error = "cannot find the section of " + names[i] + " in " + file.string() +
+                               "; generate the file again to update it";
+                return result;
+            }
+            starts.push_back(pos);
+            pos += names[i].size() + 2;
+        }
+        starts.push_back(block.size());
+        auto lead = block.substr(0, starts.front());
+
+        // What each section becomes, worked out before writing so that the
+        // header can go first: copied if `rendered` is null, otherwise the
+        // template rendered again followed by `kept`, the section's lines
+        // that did not come from the template.
+        Stamp stamp;
+        stamp.merged = b.stamp.merged;
+        std::vector<std::string_view> sections;
+        std::vector<const TemplateStore::Body*> rendered(names.size(), nullptr);
+        std::vector<std::string_view> kept(names.size());
+        for (std::size_t i = 0; i < names.size(); i++) {
+            auto section = block.substr(starts[i], starts[i + 1] - starts[i]);
+            sections.push_back(section);
+            stamp.templates.push_back(names[i]);
+            stamp.hashes.push_back(b.stamp.hashes.empty() ? 0 : b.stamp.hashes[i]);
+            bool changed_now = std::find(check.changed.begin(), check.changed.end(), names[i]) != check.changed.end();
+            if (std::find(check.missing.begin(), check.missing.end(), names[i]) != check.missing.end() ||
+                (!changed_now && !(shifted && stamp.merged)))
+                continue;
+
+            bodies.push_back(store.open_content(*store.find(names[i])));
+            auto content = bodies.back().view();
+            auto nl = std::min(section.find('\n'), section.size());
+            auto body = section.substr(std::min(nl + 1, section.size()));
+            std::size_t extent;
+            if (!changed_now) {
+                extent = merged_extent(body, content);
+            } else {
+                stamp.hashes.back() = TemplateStore::content_hash(content);
+                // Without a hash to go by, a section that reads as the
+                // template renders now is only stamped.
+                if (b.stamp.hashes.empty() && !(shifted && stamp.merged) &&
+                    body == std::string(content) + (content.ends_with('\n') ? "\n" : "\n\n"))
+                    continue;
+                extent = b.stamp.hashes.empty() ? std::string_view::npos : hashed_extent(body, b.stamp.hashes[i]);
+                // Lines --merge left out, or no hash: the section can only
+                // end where generate() ended it.
+                if (extent == std::string_view::npos && (stamp.merged || b.stamp.hashes.empty()) &&
+                    (body.ends_with("\n\n") || body.empty()))
+                    extent = body.size();
+            }
+            if (extent == std::string_view::npos) {
+                result.error = "cannot tell the lines of " + names[i] + " in " + file.string() +
+                               " from ones added by hand; generate the file again to update it";
+                return result;
+            }
+            rendered[i] = &bodies.back();
+            kept[i] = body.substr(extent);
+            if (changed_now) {
+                result.templates.push_back(names[i]);
+                shifted = true;
+            }
+        }
+
+        out.text(format_stamp(stamp));
+        out.view(lead);
+        feed(lead, 0);
+        for (std::size_t i = 0; i < names.size(); i++) {
+            auto origin = std::uint32_t(labels.size());
+            labels.push_back(names[i]);
+            if (!rendered[i]) {
+                out.view(sections[i]);
+                feed(sections[i], origin);
+                continue;
+            }
+            auto content = rendered[i]->view();
+            out.text("# " + names[i] + "\n");
+            if (stamp.merged) {
+                merge_body(out, content, origin, dedup, labels, result.dropped);
+            } else {
+                out.view(content);
+                feed(content, origin);
+            }
+            // The blank line that separates sections, as generate() writes it.
+            out.view(content.ends_with('\n') ? "\n" : "\n\n");
+            out.view(kept[i]);
+            feed(kept[i], 0);
+        }
+    }
+
+    bool ok = replace_file(file, [&](const std::filesystem::path& tmp) {
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0) return false;
+        out.set_fd(fd);
+        bool written = out.flush();
+        return close(fd) == 0 && written;
+    });
+    if (!ok) result.error = "cannot write " + file.string();
+    return result;
+}
@@ -0,0 +1,348 @@
+#include "IgnoreMatcher.hpp"
+
+#include <cstring>
+
+namespace {
+
+bool glob_special(char c) {
+    return c == '*' || c == '?' || c == '[' || c == '\\';
+}
+
+bool has_wildcard(std::string_view s) {
+    return s.find_first_of("*?[\\") != std::string_view::npos;
+}
+
+// git's trim_trailing_spaces(): drops trailing spaces unless escaped.
+std::string_view trim_trailing_spaces(std::string_view s) {
+    std::size_t last_space = std::string_view::npos;
+    for (std::size_t i = 0; i < s.size(); i++) {
+        if (s[i] == ' ') {
+            if (last_space == std::string_view::npos) last_space = i;
+        } else {
+            if (s[i] == '\\' && ++i == s.size()) return s;
+            last_space = std::string_view::npos;
+        }
+    }
+    return last_space == std::string_view::npos ? s : s.substr(0, last_space);
+}
+
+bool in_class(std::string_view cls, unsigned char c, bool& known) {
+    known = true;
+    bool upper = c >= 'A' && c <= 'Z';
+    bool lower = c >= 'a' && c <= 'z';
+    bool digit = c >= '0' && c <= '9';
+    bool space = c == ' ' || (c >= '\t' && c <= '\r');
+    bool print = c >= 0x20 && c < 0x7f;
+    if (cls == "alnum") return upper || lower || digit;
+    if (cls == "alpha") return upper || lower;
+    if (cls == "blank") return c == ' ' || c == '\t';
+    if (cls == "cntrl") return c < 0x20 || c == 0x7f;
+    if (cls == "digit") return digit;
+    if (cls == "graph") return print && c != ' ';
+    if (cls == "lower") return lower;
+    if (cls == "print") return print;
+    if (cls == "punct") return print && c != ' ' && !upper && !lower && !digit;
+    if (cls == "space") return space;
+    if (cls == "upper") return upper;
+    if (cls == "xdigit") return digit || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+    known = false;
+    return false;
+}
+
+enum Wild { wild_match, wild_nomatch, wild_abort_all, wild_abort_to_starstar };
+
+// git's wildmatch() with WM_PATHNAME: `*`, `?` and brackets stop at '/',
+// `**` between slashes spans directories. The pattern is NUL-terminated,
+// the text ends at `end`.
+Wild dowild(const unsigned char* p, const char* text, const char* end) {
+    const unsigned char* pattern = p;
+    auto at = [end](const char* t) -> unsigned char { return t < end ? (unsigned char)*t : 0; };
+
+    for (unsigned char p_ch; (p_ch = *p) != '\0'; text++, p++) {
+        unsigned char t_ch = at(text);
+        if (t_ch == '\0' && p_ch != '*') return wild_abort_all;
+        switch (p_ch) {
+        case '\\':
+            // Literal match with the next character; a trailing backslash
+            // fails in the default case.
+            p_ch = *++p;
+            [[fallthrough]];
+        default:
+            if (t_ch != p_ch) return wild_nomatch;
+            continue;
+        case '?':
+            if (t_ch == '/') return wild_nomatch;
+            continue;
+        case '*': {
+            bool match_slash = false;
+            if (*++p == '*') {
+                const unsigned char* prev_p = p - 2;
+                while (*++p == '*') {}
+                if ((prev_p < pattern || *prev_p == '/') &&
+                    (*p == '\0' || *p == '/' || (p[0] == '\\' && p[1] == '/'))) {
+                    // "**/" may also match no directory at all.
+                    if (p[0] == '/' && dowild(p + 1, text, end) == wild_match) return wild_match;
+                    match_slash = true;
+                }
+            }
+            if (*p == '\0') {
+                // Trailing "**" matches everything, "*" only within the name.
+                if (!match_slash && std::memchr(text, '/', end - text)) return wild_nomatch;
+                return wild_match;
+            }
+            if (!match_slash && *p == '/') {
+                // "*/" matches the rest of this directory name.
+                auto slash = static_cast<const char*>(std::memchr(text, '/', end - text));
+                if (!slash) return wild_nomatch;
+                text = slash;
+                break;  // the slash is consumed by the loop
+            }
+            for (;;) {
+                if (t_ch == '\0') break;
+                // Skip ahead to the literal that follows the star.
+                if (!glob_special(*p)) {
+                    p_ch = *p;
+                    while ((t_ch = at(text)) != '\0' && (match_slash || t_ch != '/')) {
+                        if (t_ch == p_ch) break;
+                        text++;
+                    }
+                    if (t_ch != p_ch) return wild_nomatch;
+                }
+                Wild m = dowild(p, text, end);
+                if (m != wild_nomatch) {
+                    if (!match_slash || m != wild_abort_to_starstar) return m;
+                } else if (!match_slash && t_ch == '/') {
+                    return wild_abort_to_starstar;
+                }
+                t_ch = at(++text);
+            }
+            return wild_abort_all;
+        }
+        case '[': {
+            p_ch = *++p;
+            if (p_ch == '^') p_ch = '!';
+            bool negated = p_ch == '!';
+            if (negated) p_ch = *++p;
+            unsigned char prev_ch = 0;
+            bool matched = false;
+            do {
+                if (!p_ch) return wild_abort_all;
+                if (p_ch == '\\') {
+                    p_ch = *++p;
+                    if (!p_ch) return wild_abort_all;
+                    if (t_ch == p_ch) matched = true;
+                } else if (p_ch == '-' && prev_ch && p[1] && p[1] != ']') {
+                    p_ch = *++p;
+                    if (p_ch == '\\') {
+                        p_ch = *++p;
+                        if (!p_ch) return wild_abort_all;
+                    }
+                    if (t_ch <= p_ch && t_ch >= prev_ch) matched = true;
+                    p_ch = 0;  // a range cannot start another range
+                } else if (p_ch == '[' && p[1] == ':') {
+                    const unsigned char* s = p += 2;
+                    while ((p_ch = *p) && p_ch != ']') p++;
+                    if (!p_ch) return wild_abort_all;
+                    if (p - s < 1 || p[-1] != ':') {
+                        // No ":]", so the '[' is an ordinary member.
+                        p = s - 2;
+                        p_ch = '[';
+                        if (t_ch == p_ch) matched = true;
+                        continue;
+                    }
+                    bool known;
+                    if (in_class(std::string_view((const char*)s, p - s - 1), t_ch, known)) matched = true;
+                    if (!known) return wild_abort_all;
+                    p_ch = 0;
+                } else if (t_ch == p_ch) {
+                    matched = true;
+                }
+            } while (prev_ch = p_ch, (p_ch = *++p) != ']');
+            if (matched == negated || t_ch == '/') return wild_nomatch;
+            continue;
+        }
+        }
+    }
+    return text < end ? wild_nomatch : wild_match;
+}
+
+bool wildmatch(const std::string& pattern, std::string_view text) {
+    return dowild(reinterpret_cast<const unsigned char*>(pattern.c_str()),
+                  text.data(), text.data() + text.size()) == wild_match;
+}
+
+} // namespace
+
+std::uint64_t IgnoreMatcher::mask_of(std::string_view text) {
+    std::uint64_t m = 0;
+    for (char c : text) m |= std::uint64_t(1) << ((unsigned char)c & 63);
+    return m;
+}
+
+IgnoreMatcher::Glob IgnoreMatcher::compile_glob(std::uint32_t rule, std::string_view pattern) {
+    Glob g{rule, 0, 0, 0};
+    g.prefix = (std::uint32_t)pattern.find_first_of("*?[\\");
+
+    // The suffix follows the last wildcard; a leading '/' is dropped since
+    // "**/" can match nothing.
+    auto last = pattern.find_last_of("*?]");
+    auto tail = pattern.substr(last + 1);
+    if (tail.find_first_of("[\\") == std::string_view::npos) {
+        if (tail.starts_with('/')) tail.remove_prefix(1);
+        g.suffix = (std::uint32_t)tail.size();
+    }
+
+    // Characters every match must contain, '/' again excepted; brackets end
+    // the scan.
+    for (std::size_t i = 0; i < pattern.size(); i++) {
+        char c = pattern[i];
+        if (c == '[') break;
+        if (c == '*' || c == '?' || c == '/') continue;
+        if (c == '\\') {
+            if (++i == pattern.size()) break;
+            c = pattern[i];
+        }
+        g.mask |= std::uint64_t(1) << ((unsigned char)c & 63);
+    }
+    return g;
+}
+
+void IgnoreMatcher::add(std::string_view content, std::string source) {
+    auto src = (std::uint32_t)sources.size();
+    sources.push_back(std::move(source));
+    if (content.starts_with("\xEF\xBB\xBF")) content.remove_prefix(3);
+
+    std::uint32_t line_no = 0;
+    std::size_t pos = 0;
+    while (pos < content.size()) {
+        auto nl = content.find('\n', pos);
+        auto line = content.substr(pos, nl == std::string_view::npos ? std::string_view::npos : nl - pos);
+        pos = nl == std::string_view::npos ? content.size() : nl + 1;
+        line_no++;
+
+        line = trim_trailing_spaces(line);
+        if (line.empty() || line[0] == '#') continue;
+
+        Rule r;
+        r.text = line;
+        r.source = src;
+        r.line = line_no;
+        if (line[0] == '!') {
+            r.negated = true;
+            line.remove_prefix(1);
+        }
+        if (line.ends_with('/')) {
+            r.dir_only = true;
+            line.remove_suffix(1);
+        }
+        r.anchored = line.find('/') != std::string_view::npos;
+        if (r.anchored && line.starts_with('/')) line.remove_prefix(1);
+        if (line.empty()) continue;
+        r.pattern = line;
+
+        auto id = (std::uint32_t)rules.size();
+        std::string_view p = r.pattern;
+        if (r.anchored) {
+            if (!has_wildcard(p)) paths[r.pattern].push_back(id);
+            else path_globs.push_back(compile_glob(id, p));
+        } else if (!has_wildcard(p)) {
+            names[r.pattern].push_back(id);
+        } else if (p.size() > 1 && p[0] == '*' && !has_wildcard(p.substr(1))) {
+            auto dot = p.find('.');
+            if (dot != std::string_view::npos) suffixes[std::string(p.substr(dot))].push_back(id);
+            else ends.push_back(id);
+        } else {
+            name_globs.push_back(compile_glob(id, p));
+        }
+        rules.push_back(std::move(r));
+    }
+    // New rules may change any verdict.
+    cached_dir.clear();
+    cached.clear();
+}
+
+int IgnoreMatcher::match(std::string_view path, bool is_dir) const {
+    int best = -1;
+    auto slash = path.rfind('/');
+    auto name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+
+    // Every list is in rule order, so each is scanned from the back and only
+    // down to the best rule found so far.
+    auto allowed = [&](std::uint32_t r) { return !rules[r].dir_only || is_dir; };
+    auto ends_with_literal = [&](std::uint32_t r) {
+        return name.ends_with(std::string_view(rules[r].pattern).substr(1));
+    };
+    auto take_last = [&](const std::vector<std::uint32_t>& list, auto&& accept) {
+        for (auto it = list.rbegin(); it != list.rend() && (int)*it > best; ++it) {
+            if (allowed(*it) && accept(*it)) {
+                best = (int)*it;
+                return;
+            }
+        }
+    };
+    auto any = [](std::uint32_t) { return true; };
+    auto try_globs = [&](const std::vector<Glob>& globs, std::string_view text) {
+        if (globs.empty() || (int)globs.back().rule <= best) return;
+        auto mask = mask_of(text);
+        for (auto g = globs.rbegin(); g != globs.rend() && (int)g->rule > best; ++g) {
+            const auto& pattern = rules[g->rule].pattern;
+            std::string_view literal = pattern;
+            if ((g->mask & ~mask) == 0 && allowed(g->rule) &&
+                text.starts_with(literal.substr(0, g->prefix)) &&
+                text.ends_with(literal.substr(literal.size() - g->suffix)) &&
+                wildmatch(pattern, text)) {
+                best = (int)g->rule;
+                return;
+            }
+        }
+    };
+
+    if (!names.empty())
+        if (auto it = names.find(name); it != names.end()) take_last(it->second, any);
+    if (!suffixes.empty()) {
+        for (auto dot = name.find('.'); dot != std::string_view::npos; dot = name.find('.', dot + 1))
+            if (auto it = suffixes.find(name.substr(dot)); it != suffixes.end())
+                take_last(it->second, ends_with_literal);
+    }
+    take_last(ends, ends_with_literal);
+    try_globs(name_globs, name);
+    if (!paths.empty())
+        if (auto it = paths.find(path); it != paths.end()) take_last(it->second, any);
+    try_globs(path_globs, path);
+    return best;
+}
+
+int IgnoreMatcher::check(std::string_view path, bool is_dir) {
+    auto slash = path.rfind('/');
+    if (slash == std::string_view::npos) return match(path, is_dir);
+    auto dir = path.substr(0, slash);
+
+    // Keep the cached components this directory shares with the last one.
+    std::size_t common = 0;
+    std::size_t limit = std::min(dir.size(), cached_dir.size());
+    while (common < limit && dir[common] == cached_dir[common]) common++;
+    std::size_t keep = 0;
+    while (keep < cached.size()) {
+        auto end = cached[keep].first;
+        if (end > common || (end < dir.size() && dir[end] != '/')) break;
+        keep++;
+    }
+    cached.resize(keep);
+    cached_dir.assign(dir);
+
+    std::size_t start = keep ? cached.back().first + 1 : 0;
+    while (start <= dir.size()) {
+        auto end = dir.find('/', start);
+        if (end == std::string_view::npos) end = dir.size();
+        int excluded = cached.empty() ? -1 : cached.back().second;
+        if (excluded < 0) {
+            int r = match(dir.substr(0, end), true);
+            if (ignores(r)) excluded = r;
+        }
+        cached.emplace_back(end, excluded);
+        start = end + 1;
+    }
+
+    if (int parent = cached.back().second; parent >= 0) return parent;
+    return match(path, is_dir);
+}
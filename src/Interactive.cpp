@@ -1,7 +1,9 @@
 #include "Interactive.hpp"
 #include "Common.hpp"
+#include "SearchIndex.hpp"
 
 #include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include <termios.h>
 #include <unistd.h>
@@ -49,9 +51,49 @@ int InteractiveSelector::read_key() {
     return (unsigned char)c;
 }
 
-void InteractiveSelector::move_up_and_clear(int lines) {
-    for (int i = 0; i < lines; i++)
-        std::cout << "\033[A\033[2K";
+// Repaints only the lines that differ from the previous frame, in a single
+// write().
+void InteractiveSelector::present(const std::vector<std::string>& next) {
+    const int old_n = (int)frame.size();
+    const int new_n = (int)next.size();
+    int row = old_n;
+
+    out.clear();
+    auto go = [&](int target) {
+        if (target < row) out += "\033[" + std::to_string(row - target) + "A";
+        else if (target > row) out += "\033[" + std::to_string(target - row) + "B";
+        out += '\r';
+        row = target;
+    };
+
+    for (int i = 0; i < new_n; i++) {
+        if (i < old_n && frame[i] == next[i]) continue;
+        // Rows up to old_n exist on screen; later ones are created by the
+        // newline written after the previous row.
+        if (i <= old_n) go(i);
+        out += "\033[2K";
+        out += next[i];
+        if (i >= old_n) {
+            out += '\n';
+            row = i + 1;
+        }
+    }
+    for (int i = new_n; i < old_n; i++) {
+        go(i);
+        out += "\033[2K";
+    }
+    go(new_n);
+
+    std::size_t done = 0;
+    while (done < out.size()) {
+        auto n = write(STDOUT_FILENO, out.data() + done, out.size() - done);
+        if (n <= 0) break;
+        done += n;
+    }
+
+    frame.resize(next.size());
+    for (std::size_t i = 0; i < next.size(); i++)
+        if (frame[i] != next[i]) frame[i] = next[i];
 }
 
 std::vector<std::string> InteractiveSelector::select(
@@ -63,41 +105,41 @@ std::vector<std::string> InteractiveSelector::select(
         return {};
     }
 
-    std::unordered_set<std::string> selected = preselected;
+    std::vector<char> selected(all_names.size(), 0);
+    std::size_t selected_count = 0;
+    for (std::size_t i = 0; i < all_names.size(); i++)
+        if (preselected.count(all_names[i])) { selected[i] = 1; selected_count++; }
+
     std::string filter;
-    std::vector<std::string> visible = all_names;
+    SearchIndex index(all_names);
+    std::vector<std::uint32_t> visible;
+    visible.reserve(all_names.size());
     int cursor = 0;
     int scroll = 0;
     const int PAGE = 15;
-    int rendered = 0;
 
+    // Typing narrows the previous result inside SearchIndex, backspace
+    // queries from scratch.
     auto refilter = [&]() {
         visible.clear();
-        if (filter.empty()) {
-            visible = all_names;
-        } else {
-            std::string fl = filter;
-            std::transform(fl.begin(), fl.end(), fl.begin(), ::tolower);
-            for (const auto& name : all_names) {
-                std::string n = name;
-                std::transform(n.begin(), n.end(), n.begin(), ::tolower);
-                if (n.find(fl) != std::string::npos) visible.push_back(name);
-            }
-        }
+        for (const auto& hit : index.query(filter)) visible.push_back(hit.id);
         if (cursor >= (int)visible.size()) cursor = (int)visible.size() - 1;
         if (cursor < 0) cursor = 0;
         scroll = 0;
     };
 
-    auto render = [&]() {
-        if (rendered > 0) move_up_and_clear(rendered);
-        rendered = 0;
+    std::vector<std::string> next;
+    std::size_t used = 0;
+    auto ln = [&](auto&&... args) -> std::string& {
+        if (used == next.size()) next.emplace_back();
+        auto& line = next[used++];
+        line.clear();
+        (line.append(args), ...);
+        return line;
+    };
 
-        auto ln = [&](auto&&... args) {
-            (std::cout << ... << args);
-            std::cout << "\n";
-            rendered++;
-        };
+    auto render = [&]() {
+        used = 0;
 
         ln(color::bold, color::cyan, "Select templates", color::reset,
            color::gray, "  ↑↓ move  Space toggle  Enter confirm  q quit", color::reset);
@@ -114,46 +156,48 @@ std::vector<std::string> InteractiveSelector::select(
 
             int end = std::min(scroll + PAGE, (int)visible.size());
             for (int i = scroll; i < end; i++) {
-                const auto& name = visible[i];
-                bool sel = selected.count(name) > 0;
+                const auto& name = all_names[visible[i]];
+                bool sel = selected[visible[i]];
                 bool cur = (i == cursor);
 
-                std::string prefix  = cur ? "> " : "  ";
-                std::string box     = sel ? "[x] " : "[ ] ";
-                std::string boxcol  = sel ? color::green : color::gray;
-                std::string namecol;
-                if      (cur && sel) namecol = color::bold + color::green;
-                else if (cur)        namecol = color::bold + color::white;
-                else if (sel)        namecol = color::green;
-                else                 namecol = color::reset;
-
-                ln(cur ? color::bold + color::white : color::gray, prefix, color::reset,
-                   boxcol, box, color::reset,
-                   namecol, name, color::reset);
+                const std::string& boxcol = sel ? color::green : color::gray;
+                auto& line = ln(cur ? color::bold : "", cur ? color::white : color::gray,
+                                cur ? "> " : "  ", color::reset,
+                                boxcol, sel ? "[x] " : "[ ] ", color::reset);
+                if      (cur && sel) line.append(color::bold).append(color::green);
+                else if (cur)        line.append(color::bold).append(color::white);
+                else if (sel)        line.append(color::green);
+                else                 line.append(color::reset);
+                line.append(name).append(color::reset);
             }
 
             if ((int)visible.size() > PAGE) {
-                ln(color::gray, "  ... ", visible.size(), " total  (",
-                   scroll + 1, "-", end, ")", color::reset);
+                ln(color::gray, "  ... ", std::to_string(visible.size()), " total  (",
+                   std::to_string(scroll + 1), "-", std::to_string(end), ")", color::reset);
             }
         }
 
-        std::cout << color::gray << "Selected " << selected.size() << ": " << color::reset;
-        int shown = 0;
-        for (const auto& name : all_names) {
-            if (!selected.count(name)) continue;
-            if (shown >= 6) { std::cout << color::gray << "+" << (selected.size() - 6) << " more"; break; }
-            std::cout << color::green << name << color::reset << " ";
+        auto& status = ln(color::gray, "Selected ", std::to_string(selected_count), ": ", color::reset);
+        std::size_t shown = 0;
+        for (std::size_t i = 0; i < all_names.size() && shown <= 6; i++) {
+            if (!selected[i]) continue;
+            if (shown == 6) {
+                status.append(color::gray).append("+").append(std::to_string(selected_count - 6)).append(" more");
+                break;
+            }
+            status.append(color::green).append(all_names[i]).append(color::reset).append(" ");
             shown++;
         }
-        std::cout << "\n";
-        rendered++;
 
-        std::cout.flush();
+        next.resize(used);
+        present(next);
     };
 
+    std::cout.flush();
     enable_raw();
-    std::cout << "\033[?25l";
+    frame.clear();
+    refilter();
+    std::cout << "\033[?25l" << std::flush;
     render();
 
     bool done = false;
@@ -170,9 +214,10 @@ std::vector<std::string> InteractiveSelector::select(
                 break;
             case K_SPACE:
                 if (!visible.empty()) {
-                    const auto& name = visible[cursor];
-                    if (selected.count(name)) selected.erase(name);
-                    else selected.insert(name);
+                    auto id = visible[cursor];
+                    selected[id] = !selected[id];
+                    if (selected[id]) selected_count++;
+                    else selected_count--;
                 }
                 break;
             case K_ENTER:
@@ -191,9 +236,9 @@ std::vector<std::string> InteractiveSelector::select(
         if (!done) render();
     }
 
-    std::cout << "\033[?25h";
+    std::cout << "\033[?25h" << std::flush;
     disable_raw();
-    move_up_and_clear(rendered);
+    present({});
 
     if (cancelled) {
         std::cout << color::yellow << "Cancelled." << color::reset << "\n";
@@ -201,8 +246,7 @@ std::vector<std::string> InteractiveSelector::select(
     }
 
     std::vector<std::string> result;
-    for (const auto& name : all_names) {
-        if (selected.count(name)) result.push_back(name);
-    }
+    for (std::size_t i = 0; i < all_names.size(); i++)
+        if (selected[i]) result.push_back(all_names[i]);
     return result;
 }
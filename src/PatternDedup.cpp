@@ -0,0 +1,65 @@
+#include "PatternDedup.hpp"
+
+namespace {
+
+bool has_wildcard(std::string_view s) {
+    return s.find_first_of("*?[\\") != std::string_view::npos;
+}
+
+// Last path component of a pattern, without negation or trailing slash.
+std::string_view last_name(std::string_view p) {
+    if (p.starts_with('!')) p.remove_prefix(1);
+    if (p.ends_with('/')) p.remove_suffix(1);
+    auto slash = p.rfind('/');
+    return slash == std::string_view::npos ? p : p.substr(slash + 1);
+}
+
+} // namespace
+
+std::string_view PatternDedup::normalize(std::string_view line) {
+    if (line.ends_with('\r')) line.remove_suffix(1);
+    while (line.ends_with(' ') && !(line.size() > 1 && line[line.size() - 2] == '\\'))
+        line.remove_suffix(1);
+    if (line.empty() || line[0] == '#') return {};
+
+    // "**/name" matches the same paths as "name" when name has no inner slash.
+    if (line.starts_with("**/")) {
+        auto rest = line.substr(3);
+        auto slash = rest.find('/');
+        if (!rest.empty() && (slash == std::string_view::npos || slash == rest.size() - 1))
+            line = rest;
+    }
+    return line;
+}
+
+bool PatternDedup::may_overlap(std::string_view a, std::string_view b) {
+    if (has_wildcard(a) || has_wildcard(b)) return true;
+    return last_name(a) == last_name(b);
+}
+
+bool PatternDedup::admit(std::string_view line, std::uint32_t origin, std::uint32_t* first) {
+    auto key = normalize(line);
+    if (key.empty()) return true;
+
+    bool negation = key[0] == '!';
+    auto& own = negation ? negations : positives;
+    auto [it, inserted] = seen.try_emplace(key, Seen{seq + 1, origin});
+    if (!inserted) {
+        // Redundant unless an overlapping line of the other sign came since.
+        const auto& other = negation ? positives : negations;
+        bool redundant = true;
+        for (auto e = other.rbegin(); e != other.rend() && e->seq > it->second.last; ++e) {
+            if (may_overlap(key, e->key)) {
+                redundant = false;
+                break;
+            }
+        }
+        if (redundant) {
+            if (first) *first = it->second.origin;
+            return false;
+        }
+        it->second.last = seq + 1;
+    }
+    own.push_back({key, ++seq});
+    return true;
+}
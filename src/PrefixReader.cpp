@@ -0,0 +1,332 @@
+#include "PrefixReader.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>) && !defined(AUTOIGNORE_NO_IO_URING)
+#define AUTOIGNORE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+constexpr unsigned batch_size = 64;
+constexpr unsigned max_default_threads = 8;
+// Fewer files than this per thread are not worth starting one for.
+constexpr std::size_t files_per_thread = 16;
+constexpr int open_flags = O_RDONLY | O_CLOEXEC | O_NONBLOCK | O_NOCTTY;
+
+// Reads up to `limit` bytes from the start of an open file.
+ssize_t read_prefix(int fd, char* buf, std::size_t limit) {
+    std::size_t got = 0;
+    while (got < limit) {
+        auto n = pread(fd, buf + got, limit - got, got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return got ? ssize_t(got) : -1;
+        if (n == 0) break;
+        got += n;
+    }
+    return got;
+}
+
+#ifdef AUTOIGNORE_IO_URING
+
+// Just enough of an io_uring for one batch at a time: fill up to
+// capacity() submission entries, then submit_and_wait() for all of their
+// completions.
+class Ring {
+public:
+    explicit Ring(unsigned entries) {
+        io_uring_params p{};
+        fd = int(syscall(__NR_io_uring_setup, entries, &p));
+        if (fd < 0) return;
+
+        sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sq_len = cq_len = std::max(sq_len, cq_len);
+        sq_map = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        cq_map = single ? sq_map
+                        : mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+        void* sqe_map = mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sq_map == MAP_FAILED || cq_map == MAP_FAILED || sqe_map == MAP_FAILED) {
+            if (sqe_map != MAP_FAILED) munmap(sqe_map, sqes_len);
+            release();
+            return;
+        }
+
+        auto* sq = static_cast<char*>(sq_map);
+        auto* cq = static_cast<char*>(cq_map);
+        sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        sqes = static_cast<io_uring_sqe*>(sqe_map);
+        entries_ = p.sq_entries;
+        tail = *sq_tail;
+    }
+
+    ~Ring() { shut_down(); }
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    bool ok() const { return sqes != nullptr; }
+    unsigned capacity() const { return entries_; }
+
+    io_uring_sqe* next() {
+        unsigned index = tail & sq_mask;
+        sq_array[index] = index;
+        tail++;
+        queued++;
+        auto* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof *sqe);
+        return sqe;
+    }
+
+    // Submits the queued entries and calls on_complete(user_data, res) for
+    // each of their completions. False if the ring failed, in which case
+    // the entries may or may not have run: drain() them before reusing
+    // anything they point to.
+    template <typename F>
+    bool submit_and_wait(F&& on_complete) {
+        __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+        unsigned to_submit = queued;
+        unsigned pending = queued;
+        queued = 0;
+        while (pending) {
+            long r = syscall(__NR_io_uring_enter, fd, to_submit, pending, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                in_flight = pending - to_submit;
+                return false;
+            }
+            to_submit -= std::min<unsigned>(to_submit, unsigned(r));
+            pending -= reap(on_complete);
+        }
+        return true;
+    }
+
+    // After submit_and_wait() failed: waits for the entries the kernel took
+    // to complete, submitting no more, and passes them to on_complete. Then
+    // shuts the ring down. Entries that still have not completed when
+    // waiting fails too are cancelled by the shutdown.
+    template <typename F>
+    void drain(F&& on_complete) {
+        while (in_flight) {
+            long r = syscall(__NR_io_uring_enter, fd, 0, in_flight, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (r < 0 && errno != EINTR) break;
+            in_flight -= std::min(in_flight, reap(on_complete));
+        }
+        in_flight -= std::min(in_flight, reap(on_complete));
+        shut_down();
+    }
+
+private:
+    int fd = -1;
+    void* sq_map = MAP_FAILED;
+    void* cq_map = MAP_FAILED;
+    std::size_t sq_len = 0, cq_len = 0, sqes_len = 0;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned sq_mask = 0;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    unsigned entries_ = 0;
+    unsigned tail = 0;
+    unsigned queued = 0;
+    unsigned in_flight = 0;  // submitted but not reaped when the ring failed
+
+    // Passes the completions posted so far to on_complete; returns how many.
+    template <typename F>
+    unsigned reap(F&& on_complete) {
+        unsigned head = *cq_head;
+        unsigned end = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        unsigned count = end - head;
+        for (; head != end; head++) {
+            const auto& cqe = cqes[head & cq_mask];
+            on_complete(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    void shut_down() {
+        if (sqes) munmap(sqes, sqes_len);
+        release();
+    }
+
+    void release() {
+        if (cq_map != MAP_FAILED && cq_map != sq_map) munmap(cq_map, cq_len);
+        if (sq_map != MAP_FAILED) munmap(sq_map, sq_len);
+        if (fd >= 0) close(fd);
+        sqes = nullptr;
+        fd = -1;
+    }
+};
+
+#endif
+
+} // namespace
+
+PrefixReader::PrefixReader(std::size_t limit, unsigned threads) : limit(limit), threads(threads) {
+    if (this->threads == 0)
+        this->threads = std::min(max_default_threads, std::max(1u, std::thread::hardware_concurrency()));
+}
+
+void PrefixReader::read(int dir_fd, const std::vector<std::string>& paths,
+                        const std::function<void(std::size_t, std::string_view)>& on_read) const
+{
+    if (paths.empty()) return;
+    if (!read_uring(dir_fd, paths, on_read)) read_pool(dir_fd, paths, on_read);
+}
+
+#ifdef AUTOIGNORE_IO_URING
+
+// Each batch takes two trips through the ring: one for the opens, one for
+// the reads. Operations the kernel does not support (before 5.6) are
+// redone synchronously, so an old kernel costs speed, not results.
+bool PrefixReader::read_uring(int dir_fd, const std::vector<std::string>& paths,
+                              const std::function<void(std::size_t, std::string_view)>& on_read) const
+{
+    // A handful of files is read faster than a ring is set up.
+    if (paths.size() < files_per_thread) return false;
+    Ring ring(batch_size);
+    if (!ring.ok()) return false;
+
+    const unsigned batch = ring.capacity();
+    std::unique_ptr<char[]> buf(new char[batch * limit]);
+    std::vector<int> fds(batch);
+    std::vector<int> lengths(batch);
+    constexpr int unread = INT_MIN;
+
+    for (std::size_t start = 0; start < paths.size(); start += batch) {
+        unsigned n = unsigned(std::min<std::size_t>(batch, paths.size() - start));
+
+        for (unsigned i = 0; i < n; i++) {
+            fds[i] = -1;
+            auto* sqe = ring.next();
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = dir_fd;
+            sqe->addr = reinterpret_cast<std::uintptr_t>(paths[start + i].c_str());
+            sqe->open_flags = open_flags;
+            sqe->user_data = i;
+        }
+        auto opened = [&](std::uint64_t i, int res) {
+            if (res == -EINVAL || res == -EOPNOTSUPP)
+                res = openat(dir_fd, paths[start + i].c_str(), open_flags);
+            fds[i] = res < 0 ? -1 : res;
+        };
+        bool ok = ring.submit_and_wait(opened);
+        if (!ok) {
+            // The ring broke mid-batch: collect the opens it still
+            // completes, so none leaks, then hand this batch and the rest
+            // to the pool, so that no file is reported twice.
+            ring.drain(opened);
+            for (unsigned i = 0; i < n; i++)
+                if (fds[i] >= 0) close(fds[i]);
+            std::vector<std::string> rest(paths.begin() + start, paths.end());
+            read_pool(dir_fd, rest, [&](std::size_t i, std::string_view prefix) { on_read(start + i, prefix); });
+            return true;
+        }
+
+        unsigned reads = 0;
+        for (unsigned i = 0; i < n; i++) {
+            lengths[i] = unread;
+            if (fds[i] < 0) continue;
+            auto* sqe = ring.next();
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fds[i];
+            sqe->addr = reinterpret_cast<std::uintptr_t>(buf.get() + i * limit);
+            sqe->len = unsigned(limit);
+            sqe->off = 0;
+            sqe->user_data = i;
+            reads++;
+        }
+        if (reads) {
+            auto filled = [&](std::uint64_t i, int res) {
+                if (res == -EINVAL || res == -EOPNOTSUPP)
+                    res = int(read_prefix(fds[i], buf.get() + i * limit, limit));
+                lengths[i] = res;
+            };
+            if (!ring.submit_and_wait(filled)) {
+                // Reads still in flight write into buf: let them finish
+                // before redoing the others here.
+                ring.drain(filled);
+                for (unsigned i = 0; i < n; i++)
+                    if (fds[i] >= 0 && lengths[i] == unread)
+                        lengths[i] = int(read_prefix(fds[i], buf.get() + i * limit, limit));
+                ok = false;
+            }
+        }
+
+        for (unsigned i = 0; i < n; i++) {
+            if (fds[i] < 0) continue;
+            close(fds[i]);
+            // A short first read is fine: the prefix is a hint, not a copy.
+            if (lengths[i] >= 0) on_read(start + i, std::string_view(buf.get() + i * limit, lengths[i]));
+        }
+        if (!ok) {
+            // The ring is shut down; the pool reads the rest.
+            auto next = start + n;
+            std::vector<std::string> rest(paths.begin() + next, paths.end());
+            if (!rest.empty())
+                read_pool(dir_fd, rest, [&](std::size_t i, std::string_view prefix) { on_read(next + i, prefix); });
+            return true;
+        }
+    }
+    return true;
+}
+
+#else
+
+bool PrefixReader::read_uring(int, const std::vector<std::string>&,
+                              const std::function<void(std::size_t, std::string_view)>&) const
+{
+    return false;
+}
+
+#endif
+
+void PrefixReader::read_pool(int dir_fd, const std::vector<std::string>& paths,
+                             const std::function<void(std::size_t, std::string_view)>& on_read) const
+{
+    std::atomic<std::size_t> next{0};
+    std::mutex m;
+    auto worker = [&] {
+        std::unique_ptr<char[]> buf(new char[limit]);
+        for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < paths.size();) {
+            int fd = openat(dir_fd, paths[i].c_str(), open_flags);
+            if (fd < 0) continue;
+            auto n = read_prefix(fd, buf.get(), limit);
+            close(fd);
+            if (n < 0) continue;
+            std::lock_guard lock(m);
+            on_read(i, std::string_view(buf.get(), n));
+        }
+    };
+
+    unsigned count = unsigned(std::min<std::size_t>(threads, (paths.size() + files_per_thread - 1) / files_per_thread));
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < count; i++) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+}
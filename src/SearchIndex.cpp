@@ -0,0 +1,179 @@
+#include "SearchIndex.hpp"
+
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+// Score tiers; every match in a tier outranks every match in the next.
+constexpr int score_exact = 4000;
+constexpr int score_prefix = 3000;
+constexpr int score_substring = 2000;
+constexpr int score_subsequence = 1000;
+constexpr int score_typo = 500;
+constexpr int tier_width = 499;
+
+constexpr std::size_t max_typo_query = 32;
+constexpr int max_typos_any = 2;  // loosest mask filter, kept by survivors
+
+char fold(char c) {
+    return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+}
+
+bool boundary(std::string_view s, std::size_t i) {
+    if (i == 0) return true;
+    char p = s[i - 1];
+    return p == '-' || p == '_' || p == '.' || p == ' ' || p == '/';
+}
+
+int clamp_tier(int s) {
+    return std::clamp(s, 0, tier_width);
+}
+
+// fzf-style subsequence score: rewards consecutive runs and matches at word
+// boundaries, penalises gaps. Returns -1 if q is not a subsequence of name.
+int subsequence(std::string_view name, std::string_view q) {
+    int s = 0;
+    std::size_t j = 0;
+    std::size_t prev = 0;
+    for (std::size_t i = 0; i < name.size() && j < q.size(); i++) {
+        if (name[i] != q[j]) continue;
+        s += 16;
+        if (j > 0 && prev + 1 == i) s += 24;
+        else if (j > 0) s -= (int)std::min<std::size_t>(i - prev - 1, 12);
+        if (boundary(name, i)) s += 16;
+        prev = i;
+        j++;
+    }
+    return j == q.size() ? s : -1;
+}
+
+// Smallest optimal-string-alignment distance between q and a prefix of
+// name, or limit + 1 if it exceeds limit.
+int prefix_distance(std::string_view name, std::string_view q, int limit) {
+    const std::size_t m = q.size();
+    const std::size_t n = std::min(name.size(), m + limit);
+    int rows[3][max_typo_query + 8];
+    int* prev2 = rows[0];
+    int* prev = rows[1];
+    int* cur = rows[2];
+    for (std::size_t j = 0; j <= n; j++) prev[j] = (int)j;
+    for (std::size_t i = 1; i <= m; i++) {
+        cur[0] = (int)i;
+        int row_min = cur[0];
+        for (std::size_t j = 1; j <= n; j++) {
+            int cost = q[i - 1] == name[j - 1] ? 0 : 1;
+            int d = std::min({prev[j] + 1, cur[j - 1] + 1, prev[j - 1] + cost});
+            if (i > 1 && j > 1 && q[i - 1] == name[j - 2] && q[i - 2] == name[j - 1])
+                d = std::min(d, prev2[j - 2] + 1);
+            cur[j] = d;
+            row_min = std::min(row_min, d);
+        }
+        if (row_min > limit) return limit + 1;
+        std::swap(prev2, prev);
+        std::swap(prev, cur);
+    }
+    int best = limit + 1;
+    std::size_t from = m > (std::size_t)limit ? m - limit : 0;
+    for (std::size_t j = from; j <= n; j++) best = std::min(best, prev[j]);
+    return best;
+}
+
+} // namespace
+
+SearchIndex::SearchIndex(const std::vector<std::string>& names) {
+    offsets.reserve(names.size() + 1);
+    masks.reserve(names.size());
+    for (const auto& n : names) {
+        offsets.push_back((std::uint32_t)folded.size());
+        for (char c : n) folded += fold(c);
+        masks.push_back(mask_of(n));
+    }
+    offsets.push_back((std::uint32_t)folded.size());
+    hits.reserve(names.size());
+    survivors.reserve(names.size());
+}
+
+std::uint64_t SearchIndex::mask_of(std::string_view s) {
+    std::uint64_t m = 0;
+    for (char ch : s) {
+        auto c = (unsigned char)fold(ch);
+        unsigned bit;
+        if (c >= 'a' && c <= 'z') bit = c - 'a';
+        else if (c >= '0' && c <= '9') bit = 26 + (c - '0');
+        else bit = 36 + c % 28;
+        m |= std::uint64_t(1) << bit;
+    }
+    return m;
+}
+
+int SearchIndex::max_typos(std::size_t query_len) {
+    if (query_len < 4 || query_len > max_typo_query) return 0;
+    return query_len < 8 ? 1 : 2;
+}
+
+int SearchIndex::score(std::string_view name, std::string_view q) {
+    const int extra = (int)std::min<std::size_t>(name.size() - std::min(name.size(), q.size()), 200);
+    if (auto pos = name.find(q); pos != std::string_view::npos) {
+        if (pos == 0) return name.size() == q.size() ? score_exact : score_prefix + clamp_tier(tier_width - extra);
+        int s = tier_width - 200 - (int)std::min<std::size_t>(pos, 50) - extra / 4;
+        if (boundary(name, pos)) s += 100;
+        return score_substring + clamp_tier(s);
+    }
+    if (int s = subsequence(name, q); s >= 0)
+        return score_subsequence + clamp_tier(s + 100 - extra / 4);
+    if (int k = max_typos(q.size()); k > 0) {
+        int d = prefix_distance(name, q, k);
+        if (d <= k) return score_typo + clamp_tier(tier_width - 100 * d - extra);
+    }
+    return -1;
+}
+
+const std::vector<SearchIndex::Hit>& SearchIndex::query(std::string_view q) {
+    hits.clear();
+    if (q.size() > sizeof query_buf) q = q.substr(0, sizeof query_buf);
+    for (std::size_t i = 0; i < q.size(); i++) query_buf[i] = fold(q[i]);
+    q = std::string_view(query_buf, q.size());
+
+    // The number of query characters missing from a name only grows as the
+    // query is extended, so names rejected by the loosest filter for the
+    // previous query cannot match this one.
+    bool narrowing = have_last && q.starts_with(std::string_view(last_query, last_len));
+    std::copy(q.begin(), q.end(), last_query);
+    last_len = q.size();
+    have_last = true;
+
+    if (q.empty()) {
+        survivors.clear();
+        for (std::uint32_t i = 0; i < masks.size(); i++) {
+            hits.push_back({i, 0});
+            survivors.push_back(i);
+        }
+        return hits;
+    }
+
+    const std::uint64_t qmask = mask_of(q);
+    const int k = max_typos(q.size());
+    std::size_t kept = 0;
+    auto visit = [&](std::uint32_t i) {
+        // Each query character missing from the name costs at least one edit.
+        int missing = std::popcount(qmask & ~masks[i]);
+        if (missing > max_typos_any) return;
+        survivors[kept++] = i;
+        if (missing > k) return;
+        int s = score(name(i), q);
+        if (s >= 0) hits.push_back({i, s});
+    };
+    if (narrowing) {
+        for (std::size_t j = 0; j < survivors.size(); j++) visit(survivors[j]);
+    } else {
+        survivors.resize(masks.size());
+        for (std::uint32_t i = 0; i < masks.size(); i++) visit(i);
+    }
+    survivors.resize(kept);
+
+    std::sort(hits.begin(), hits.end(), [](const Hit& a, const Hit& b) {
+        return a.score != b.score ? a.score > b.score : a.id < b.id;
+    });
+    return hits;
+}
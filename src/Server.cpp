@@ -0,0 +1,346 @@
+#include "Server.hpp"
+#include "Common.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char protocol[] = "autoignore/2";
+constexpr std::uint32_t max_request = 1 << 20;
+constexpr int request_timeout_s = 5;
+constexpr std::uint32_t watch_mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                     IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF;
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void on_stop_signal(int) { stop_requested = 1; }
+
+bool make_address(const fs::path& path, sockaddr_un& addr) {
+    std::memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (path.native().size() >= sizeof addr.sun_path) return false;
+    std::memcpy(addr.sun_path, path.c_str(), path.native().size());
+    return true;
+}
+
+// True if the process at the other end runs as the same user.
+bool same_user(int fd) {
+    ucred cred{};
+    socklen_t len = sizeof cred;
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == getuid();
+}
+
+bool read_all(int fd, void* buf, std::size_t n) {
+    auto* p = static_cast<char*>(buf);
+    while (n) {
+        auto r = read(fd, p, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+
+bool write_all(int fd, const void* buf, std::size_t n) {
+    auto* p = static_cast<const char*>(buf);
+    while (n) {
+        auto r = send(fd, p, n, MSG_NOSIGNAL);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+
+int connect_to(const fs::path& path) {
+    sockaddr_un addr;
+    if (!make_address(path, addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+} // namespace
+
+Server::Server(fs::path socket, Handler handler)
+    : socket_path(std::move(socket)), handler(std::move(handler)) {}
+
+Server::~Server() {
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path.c_str());
+    }
+    if (inotify_fd >= 0) close(inotify_fd);
+}
+
+fs::path Server::default_socket() {
+    if (const char* env = std::getenv("AUTOIGNORE_SOCKET")) return env;
+    if (const char* runtime = std::getenv("XDG_RUNTIME_DIR"); runtime && *runtime)
+        return fs::path(runtime) / "autoignore.sock";
+    return "/tmp/autoignore-" + std::to_string(getuid()) + ".sock";
+}
+
+int Server::forward(const fs::path& socket, const std::vector<std::string>& args) {
+    if (socket.empty()) return -1;
+    int fd = connect_to(socket);
+    if (fd < 0) return -1;
+    if (!same_user(fd)) {
+        close(fd);
+        return -1;
+    }
+
+    std::string payload(protocol, sizeof protocol);
+    std::error_code ec;
+    payload += fs::current_path(ec).native();
+    payload += '\0';
+    payload += TemplateIndex::default_location().native();
+    payload += '\0';
+    TemplateStore local;  // only resolves the search path
+    const auto& paths = local.paths();
+    payload += std::to_string(paths.size());
+    payload += '\0';
+    for (const auto& p : paths) {
+        payload += p.native();
+        payload += '\0';
+    }
+    for (const auto& a : args) {
+        payload += a;
+        payload += '\0';
+    }
+    auto length = std::uint32_t(payload.size());
+
+    // The descriptors travel with the first byte; the rest follows plainly.
+    int fds[2] = {STDOUT_FILENO, STDERR_FILENO};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof fds)] = {};
+    iovec iov{&length, sizeof length};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+    auto* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof fds);
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof fds);
+
+    ssize_t sent;
+    while ((sent = sendmsg(fd, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+    std::int32_t status = -1;
+    bool ok = sent > 0 &&
+              write_all(fd, reinterpret_cast<char*>(&length) + sent, sizeof length - sent) &&
+              write_all(fd, payload.data(), payload.size()) &&
+              read_all(fd, &status, sizeof status);
+    close(fd);
+    return ok && status >= 0 ? status : -1;
+}
+
+void Server::load() {
+    store.reload();
+    store.all();
+    detector = std::make_unique<Detector>(store);
+    watch_paths();
+    stale = false;
+}
+
+// Watches each search directory, or the closest ancestor of one that does
+// not exist yet or is a pack, so that creating it, or replacing the pack
+// as `pack` does, is noticed too. Called again on every load, which moves
+// the watches down as directories appear.
+void Server::watch_paths() {
+    if (inotify_fd < 0) return;
+    for (const auto& dir : store.paths()) {
+        if (inotify_add_watch(inotify_fd, dir.c_str(), watch_mask | IN_ONLYDIR) >= 0) continue;
+        for (auto p = dir.parent_path(); !p.empty(); p = p.parent_path()) {
+            if (inotify_add_watch(inotify_fd, p.c_str(), IN_CREATE | IN_MOVED_TO | IN_ONLYDIR) >= 0) break;
+            if (p == p.root_path()) break;
+        }
+    }
+}
+
+int Server::run() {
+    struct sigaction sa{};
+    sa.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un addr;
+    if (!make_address(socket_path, addr)) {
+        std::cerr << color::red << "Error: socket path too long: " << socket_path.native() << "\n" << color::reset;
+        return 1;
+    }
+    if (int other = connect_to(socket_path); other >= 0) {
+        close(other);
+        std::cerr << color::red << "Error: a daemon is already listening on " << socket_path.native()
+                  << "\n" << color::reset;
+        return 1;
+    }
+    unlink(socket_path.c_str());
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    mode_t old_mask = umask(077);
+    bool bound = listen_fd >= 0 && bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == 0;
+    umask(old_mask);
+    if (!bound || listen(listen_fd, 16) != 0) {
+        std::cerr << color::red << "Error: cannot listen on " << socket_path.native() << ": "
+                  << std::strerror(errno) << "\n" << color::reset;
+        if (listen_fd >= 0) close(listen_fd);
+        listen_fd = -1;
+        return 1;
+    }
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    load();
+    std::cout << color::green << "Serving on " << color::bold << socket_path.native() << color::reset
+              << color::gray << " (" << store.all().size() << " templates)" << color::reset << "\n"
+              << std::flush;
+
+    while (!stop_requested) {
+        pollfd fds[2] = {{listen_fd, POLLIN, 0}, {inotify_fd, POLLIN, 0}};
+        int n = poll(fds, inotify_fd >= 0 ? 2 : 1, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (inotify_fd >= 0 && (fds[1].revents & POLLIN)) {
+            // The events only say that something changed; the store works
+            // out what on the next load, from the directory mtimes and, for
+            // templates rewritten in place, each file's size and mtime.
+            alignas(inotify_event) char buf[4096];
+            while (read(inotify_fd, buf, sizeof buf) > 0) {}
+            stale = true;
+        }
+        if (fds[0].revents & POLLIN) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) continue;
+            if (same_user(fd)) serve_connection(fd);
+            close(fd);
+        }
+    }
+    return 0;
+}
+
+void Server::serve_connection(int fd) {
+    // A client that stalls mid-request must not hold up the others.
+    timeval timeout{request_timeout_s, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    while (!stop_requested && serve_request(fd)) {}
+}
+
+bool Server::serve_request(int fd) {
+    std::uint32_t length = 0;
+    int fds[2] = {-1, -1};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof fds)];
+    iovec iov{&length, sizeof length};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+
+    ssize_t got;
+    while ((got = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {}
+    if (got <= 0) return false;
+    for (auto* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS && c->cmsg_len == CMSG_LEN(sizeof fds))
+            std::memcpy(fds, CMSG_DATA(c), sizeof fds);
+    auto drop_fds = [&] {
+        for (int f : fds)
+            if (f >= 0) close(f);
+    };
+
+    std::string payload;
+    bool ok = fds[0] >= 0 && fds[1] >= 0 && !(msg.msg_flags & MSG_CTRUNC) &&
+              read_all(fd, reinterpret_cast<char*>(&length) + got, sizeof length - got) &&
+              length <= max_request;
+    if (ok) {
+        payload.resize(length);
+        ok = read_all(fd, payload.data(), length);
+    }
+    // A client speaking another version gets no reply and falls back to
+    // running the command itself.
+    if (!ok || payload.compare(0, sizeof protocol, protocol, sizeof protocol) != 0) {
+        drop_fds();
+        return false;
+    }
+
+    std::vector<std::string> fields;
+    for (std::size_t start = sizeof protocol, end; (end = payload.find('\0', start)) != std::string::npos;
+         start = end + 1)
+        fields.emplace_back(payload, start, end - start);
+    // The client's templates must be the ones loaded here; if not, no
+    // reply, and it runs the command itself.
+    std::size_t path_count = fields.size() >= 3 ? std::strtoul(fields[2].c_str(), nullptr, 10) : 0;
+    const auto& paths = store.paths();
+    bool same_store = fields.size() >= 3 && fields[1] == TemplateIndex::default_location().native() &&
+                      path_count == paths.size() && fields.size() - 3 >= path_count &&
+                      std::equal(paths.begin(), paths.end(), fields.begin() + 3,
+                                 [](const fs::path& p, const std::string& f) { return p.native() == f; });
+    if (!same_store) {
+        drop_fds();
+        return false;
+    }
+    std::string cwd = std::move(fields.front());
+    fields.erase(fields.begin(), fields.begin() + 3 + path_count);
+
+    if (stale) load();
+
+    // Borrow the client's stdout and stderr for the length of the command.
+    std::cout.flush();
+    std::cerr.flush();
+    int saved_out = dup(STDOUT_FILENO);
+    int saved_err = dup(STDERR_FILENO);
+    dup2(fds[0], STDOUT_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+    drop_fds();
+
+    std::int32_t status;
+    if (chdir(cwd.c_str()) != 0) {
+        std::cerr << color::red << "Error: cannot enter " << cwd << ": " << std::strerror(errno)
+                  << "\n" << color::reset;
+        status = 1;
+    } else {
+        try {
+            status = handler(store, *detector, std::move(fields));
+        } catch (const std::exception& e) {
+            std::cerr << color::red << "Error: " << e.what() << "\n" << color::reset;
+            status = 1;
+        }
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(stdout);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+    // Do not keep the client's directory busy; failing that is harmless.
+    if (chdir("/") != 0) errno = 0;
+    std::cout.clear();
+    std::cerr.clear();
+
+    return write_all(fd, &status, sizeof status);
+}
@@ -0,0 +1,108 @@
+#include "Stats.hpp"
+#include "Common.hpp"
+
+#include <cstring>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+int thread_id() {
+#ifdef __linux__
+    return int(syscall(SYS_gettid));
+#else
+    return 0;
+#endif
+}
+
+long peak_rss_kb() {
+    rusage ru{};
+    return getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_maxrss : 0;
+}
+
+} // namespace
+
+Stats::Stats() : origin(std::chrono::steady_clock::now()) {
+    active = this;
+}
+
+Stats::~Stats() {
+    if (active == this) active = nullptr;
+}
+
+const char* Stats::counter_name(Counter c) {
+    switch (c) {
+        case template_dirs_scanned: return "template_dirs_scanned";
+        case headers_parsed:        return "headers_parsed";
+        case templates:             return "templates";
+        case dirs_opened:           return "dirs_opened";
+        case entries:               return "entries";
+        case entries_pruned:        return "entries_pruned";
+        case matcher_calls:         return "matcher_calls";
+        case glob_checks:           return "glob_checks";
+        case content_files_read:    return "content_files_read";
+        case bytes_read:            return "bytes_read";
+        case bytes_written:         return "bytes_written";
+        case counter_count:         break;
+    }
+    return "";
+}
+
+void Stats::record(const char* phase, std::chrono::steady_clock::time_point start,
+                   std::chrono::steady_clock::time_point end)
+{
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    Span s{phase, duration_cast<microseconds>(start - origin).count(),
+           duration_cast<microseconds>(end - start).count(), thread_id()};
+    std::lock_guard lock(m);
+    spans.push_back(s);
+}
+
+void Stats::write_json(std::ostream& out) const {
+    auto wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin).count();
+    out << "{\"wall_ms\": " << wall << ", \"peak_rss_kb\": " << peak_rss_kb() << ", \"phases\": {";
+
+    // Spans of the same phase are summed, in the order phases first ran.
+    std::lock_guard lock(m);
+    std::vector<std::pair<const char*, std::pair<std::int64_t, std::size_t>>> phases;
+    for (const auto& s : spans) {
+        auto it = phases.begin();
+        while (it != phases.end() && std::strcmp(it->first, s.name) != 0) ++it;
+        if (it == phases.end()) it = phases.insert(phases.end(), {s.name, {0, 0}});
+        it->second.first += s.duration_us;
+        it->second.second++;
+    }
+    for (std::size_t i = 0; i < phases.size(); i++) {
+        const auto& [name, total] = phases[i];
+        out << (i ? ", " : "") << json::quote(name) << ": {\"ms\": " << double(total.first) / 1000
+            << ", \"calls\": " << total.second << "}";
+    }
+    out << "}, \"counters\": {";
+    for (unsigned c = 0; c < counter_count; c++)
+        out << (c ? ", " : "") << json::quote(counter_name(Counter(c))) << ": "
+            << counters[c].load(std::memory_order_relaxed);
+    out << "}}\n";
+}
+
+void Stats::write_trace(std::ostream& out) const {
+    int pid = int(getpid());
+    out << "{\"traceEvents\": [\n";
+    std::lock_guard lock(m);
+    for (const auto& s : spans)
+        out << "{\"name\": " << json::quote(s.name) << ", \"cat\": \"autoignore\", \"ph\": \"X\", \"ts\": "
+            << s.start_us << ", \"dur\": " << s.duration_us << ", \"pid\": " << pid << ", \"tid\": " << s.tid
+            << "},\n";
+    // The counters as they stand at the end, as one counter event each.
+    auto end_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+    for (unsigned c = 0; c < counter_count; c++)
+        out << "{\"name\": " << json::quote(counter_name(Counter(c))) << ", \"ph\": \"C\", \"ts\": " << end_us
+            << ", \"pid\": " << pid << ", \"args\": {\"value\": " << counters[c].load(std::memory_order_relaxed)
+            << "}},\n";
+    out << "{\"name\": \"peak_rss_kb\", \"ph\": \"C\", \"ts\": " << end_us << ", \"pid\": " << pid
+        << ", \"args\": {\"value\": " << peak_rss_kb() << "}}\n]}\n";
+}
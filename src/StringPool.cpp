@@ -0,0 +1,63 @@
+#include "StringPool.hpp"
+
+#include <cstring>
+
+char* StringPool::raw(std::size_t n, std::size_t align) {
+    auto pad = (align - reinterpret_cast<std::uintptr_t>(next) % align) % align;
+    if (next && pad + n <= left) {
+        char* p = next + pad;
+        next = p + n;
+        left -= pad + n;
+        return p;
+    }
+    // Blocks come from new[], aligned for any fundamental type. Something
+    // larger than a block gets one of its own and leaves the current one
+    // in use.
+    if (n > block_size / 4) {
+        blocks.push_back(std::make_unique_for_overwrite<char[]>(n));
+        return blocks.back().get();
+    }
+    if (!blocks.empty() && block_size < max_block) block_size *= 2;
+    blocks.push_back(std::make_unique_for_overwrite<char[]>(block_size));
+    next = blocks.back().get() + n;
+    left = block_size - n;
+    return blocks.back().get();
+}
+
+std::string_view StringPool::store(std::string_view s) {
+    char* p = raw(s.size() + 1, 1);
+    if (!s.empty()) std::memcpy(p, s.data(), s.size());
+    p[s.size()] = '\0';
+    return std::string_view(p, s.size());
+}
+
+std::string_view StringPool::store(std::initializer_list<std::string_view> parts) {
+    std::size_t size = 0;
+    for (auto part : parts) size += part.size();
+    char* p = raw(size + 1, 1);
+    char* out = p;
+    for (auto part : parts) {
+        if (!part.empty()) std::memcpy(out, part.data(), part.size());
+        out += part.size();
+    }
+    *out = '\0';
+    return std::string_view(p, size);
+}
+
+StringPool::Id StringPool::intern(std::string_view s) {
+    if (auto it = ids.find(s); it != ids.end()) return it->second;
+    auto id = Id(interned.size());
+    auto copy = store(s);
+    interned.push_back(copy);
+    ids.emplace(copy, id);
+    return id;
+}
+
+void StringPool::clear() {
+    blocks.clear();
+    block_size = first_block;
+    next = nullptr;
+    left = 0;
+    interned.clear();
+    ids.clear();
+}
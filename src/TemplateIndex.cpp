@@ -0,0 +1,180 @@
+#include "TemplateIndex.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char magic[8] = {'A', 'I', 'G', 'N', 'I', 'D', 'X', '\0'};
+constexpr std::uint32_t format_version = 4;
+
+class Reader {
+public:
+    Reader(const char* data, std::size_t size) : p(data), end(data + size) {}
+
+    bool ok() const { return good; }
+
+    template <typename T>
+    T num() {
+        T v{};
+        if (!take(sizeof v)) return v;
+        std::memcpy(&v, p - sizeof v, sizeof v);
+        return v;
+    }
+
+    std::string_view str() {
+        auto n = num<std::uint32_t>();
+        if (!take(n)) return {};
+        return std::string_view(p - n, n);
+    }
+
+private:
+    const char* p;
+    const char* end;
+    bool good = true;
+
+    bool take(std::size_t n) {
+        if (!good || std::size_t(end - p) < n) { good = false; return false; }
+        p += n;
+        return true;
+    }
+};
+
+class Writer {
+public:
+    std::string buf;
+
+    template <typename T>
+    void num(T v) { buf.append(reinterpret_cast<const char*>(&v), sizeof v); }
+
+    void str(std::string_view s) {
+        num(std::uint32_t(s.size()));
+        buf.append(s);
+    }
+};
+
+} // namespace
+
+fs::path TemplateIndex::default_location() {
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+        return fs::path(xdg) / "autoignore" / "index.bin";
+    if (const char* home = std::getenv("HOME"); home && *home)
+        return fs::path(home) / ".cache" / "autoignore" / "index.bin";
+    return {};
+}
+
+TemplateIndex::TemplateIndex(const fs::path& file) {
+    if (file.empty()) return;
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof magic) { close(fd); return; }
+    size = st.st_size;
+    map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        map = nullptr;
+        return;
+    }
+
+    const char* data = static_cast<const char*>(map);
+    auto& dirs = list;
+    bool ordered = true;
+    Reader r(data + sizeof magic, size - sizeof magic);
+    if (std::memcmp(data, magic, sizeof magic) == 0 && r.num<std::uint32_t>() == format_version) {
+        auto dir_count = r.num<std::uint32_t>();
+        for (std::uint32_t i = 0; i < dir_count && r.ok(); i++) {
+            Dir d;
+            d.path = r.str();
+            d.mtime = r.num<std::int64_t>();
+            d.exists = r.num<std::uint8_t>() != 0;
+            auto file_count = r.num<std::uint32_t>();
+            for (std::uint32_t j = 0; j < file_count && r.ok(); j++) {
+                File f;
+                f.name = r.str();
+                if (!d.files.empty() && !(d.files.back().name < f.name)) ordered = false;
+                f.size = r.num<std::uint64_t>();
+                f.mtime = r.num<std::int64_t>();
+                auto pattern_count = r.num<std::uint32_t>();
+                for (std::uint32_t k = 0; k < pattern_count && r.ok(); k++)
+                    f.detect_patterns.push_back(r.str());
+                auto rule_count = r.num<std::uint32_t>();
+                for (std::uint32_t k = 0; k < rule_count && r.ok(); k++)
+                    f.content_rules.push_back(r.str());
+                f.hash = r.num<std::uint64_t>();
+                d.files.push_back(std::move(f));
+            }
+            dirs.push_back(std::move(d));
+        }
+    }
+    if (!r.ok() || !ordered) dirs.clear();
+}
+
+TemplateIndex::~TemplateIndex() {
+    if (map) munmap(map, size);
+}
+
+const TemplateIndex::File* TemplateIndex::find(std::string_view file) const {
+    constexpr std::string_view suffix = ".gitignore";
+    auto slash = file.rfind('/');
+    if (slash == std::string_view::npos || !file.ends_with(suffix)) return nullptr;
+    auto dir = file.substr(0, slash);
+    auto name = file.substr(slash + 1, file.size() - slash - 1 - suffix.size());
+    for (const auto& d : list) {
+        std::string_view path = d.path.native();
+        if (path.size() > 1 && path.ends_with('/')) path.remove_suffix(1);
+        if (path != dir) continue;
+        auto it = std::lower_bound(d.files.begin(), d.files.end(), name,
+                                   [](const File& f, std::string_view n) { return f.name < n; });
+        return it != d.files.end() && it->name == name ? &*it : nullptr;
+    }
+    return nullptr;
+}
+
+bool TemplateIndex::save(const fs::path& file, const std::vector<Dir>& dirs) {
+    Writer w;
+    w.buf.append(magic, sizeof magic);
+    w.num(format_version);
+    w.num(std::uint32_t(dirs.size()));
+    for (const auto& d : dirs) {
+        w.str(d.path.native());
+        w.num(d.mtime);
+        w.num(std::uint8_t(d.exists));
+        w.num(std::uint32_t(d.files.size()));
+        for (const auto& f : d.files) {
+            w.str(f.name);
+            w.num(f.size);
+            w.num(f.mtime);
+            w.num(std::uint32_t(f.detect_patterns.size()));
+            for (const auto& p : f.detect_patterns) w.str(p);
+            w.num(std::uint32_t(f.content_rules.size()));
+            for (const auto& rule : f.content_rules) w.str(rule);
+            w.num(f.hash);
+        }
+    }
+
+    std::error_code ec;
+    fs::create_directories(file.parent_path(), ec);
+    auto tmp = file;
+    tmp += ".tmp." + std::to_string(getpid());
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    std::size_t done = 0;
+    while (done < w.buf.size()) {
+        auto n = write(fd, w.buf.data() + done, w.buf.size() - done);
+        if (n <= 0) break;
+        done += n;
+    }
+    bool ok = close(fd) == 0 && done == w.buf.size();
+    if (ok) ok = rename(tmp.c_str(), file.c_str()) == 0;
+    if (!ok) unlink(tmp.c_str());
+    return ok;
+}
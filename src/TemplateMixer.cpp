@@ -0,0 +1,306 @@
+#include "TemplateMixer.hpp"
+#include "Common.hpp"
+#include "EmbeddedTemplates.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+
+namespace {
+
+enum class Source { user, system, builtin };
+
+Source source_of(const TemplateStore& store, const TemplateStore::Template& t) {
+    if (t.path.empty()) return Source::builtin;
+    return t.dir < store.user_paths() ? Source::user : Source::system;
+}
+
+std::string_view trim(std::string_view s) {
+    auto b = s.find_first_not_of(" \t");
+    if (b == std::string_view::npos) return {};
+    auto e = s.find_last_not_of(" \t");
+    return s.substr(b, e - b + 1);
+}
+
+} // namespace
+
+TemplateMixer::TemplateMixer(TemplateStore& store) : store(store) {}
+
+std::string TemplateMixer::extract_description(std::string_view header) {
+    std::vector<std::string_view> desc_lines;
+    std::size_t pos = 0;
+    while (pos < header.size()) {
+        auto nl = header.find('\n', pos);
+        auto line = header.substr(pos, nl == std::string_view::npos ? std::string_view::npos : nl - pos);
+        pos = nl == std::string_view::npos ? header.size() : nl + 1;
+        if (line.ends_with('\r')) line.remove_suffix(1);
+        if (line.empty()) continue;
+        if (line[0] != '#') break;
+
+        // Remove leading # and whitespace
+        auto desc = line.substr(1);
+        if (desc.starts_with(' ')) desc.remove_prefix(1);
+
+        if (!desc.empty() && desc != "gitignore" && !desc.starts_with("@") &&
+            desc.find("Generated") == std::string_view::npos) {
+            desc_lines.push_back(desc);
+            if (desc_lines.size() >= 2) break;  // First meaningful comment lines
+        }
+    }
+
+    if (desc_lines.empty()) return "No description";
+
+    std::string result(desc_lines[0]);
+    if (desc_lines.size() > 1) {
+        result += " ";
+        result += desc_lines[1];
+    }
+
+    // Truncate if too long
+    if (result.length() > 60) result = result.substr(0, 57) + "...";
+    return result;
+}
+
+std::string TemplateMixer::format_size(std::uint64_t size) {
+    if (size < 1024) return std::to_string(size) + "B";
+    if (size < 1024 * 1024) return std::to_string(size / 1024) + "KB";
+    return std::to_string(size / (1024 * 1024)) + "MB";
+}
+
+void TemplateMixer::optimize_template_order(std::vector<std::string>& template_names) {
+    // Simple heuristic: put broader templates first, specific ones last
+    static const std::vector<std::string> base_templates = {
+        "global", "macos", "windows", "linux"
+    };
+    auto is_base = [](const std::string& n) {
+        return std::find(base_templates.begin(), base_templates.end(), n) != base_templates.end();
+    };
+    std::sort(template_names.begin(), template_names.end(),
+              [&](const std::string& a, const std::string& b) {
+                  bool a_is_base = is_base(a);
+                  bool b_is_base = is_base(b);
+                  if (a_is_base != b_is_base) return a_is_base;  // Base templates first
+                  return a < b;                                   // Alphabetical otherwise
+              });
+}
+
+void TemplateMixer::list_templates_detailed() {
+    const auto& templates = store.all();
+
+    if (templates.empty()) {
+        std::cout << color::yellow << "No templates found." << color::reset << "\n";
+        return;
+    }
+
+    std::cout << color::bold << "Available templates (" << templates.size() << "):" << color::reset << "\n\n";
+
+    for (const auto& tmpl : templates) {
+        auto description = extract_description(store.read_header(tmpl));
+
+        std::cout << color::green << color::bold << tmpl.name << color::reset;
+        std::cout << color::gray << " (" << format_size(tmpl.size) << ")" << color::reset;
+
+        // Source location indicator
+        switch (source_of(store, tmpl)) {
+            case Source::user:    std::cout << color::blue << " [user]" << color::reset; break;
+            case Source::system:  std::cout << color::cyan << " [system]" << color::reset; break;
+            case Source::builtin: std::cout << color::magenta << " [built-in]" << color::reset; break;
+        }
+
+        std::cout << "\n";
+        std::cout << "  " << color::gray << description << color::reset << "\n\n";
+    }
+}
+
+void TemplateMixer::preview_mix(const std::vector<std::string>& template_names) {
+    if (template_names.empty()) {
+        std::cerr << color::red << "No templates specified for preview" << color::reset << "\n";
+        return;
+    }
+
+    std::cout << color::bold << "Preview of template mix:" << color::reset << "\n";
+    for (const auto& name : template_names) std::cout << "  " << color::green << name << color::reset;
+    std::cout << "\n\n";
+
+    // One pass over each body collects both the conflicts and the counts.
+    // Patterns are views into the mapped bodies, which stay open until the
+    // report is printed.
+    struct Counts {
+        std::string name;
+        bool found = false;
+        std::size_t lines = 0;
+        std::size_t patterns = 0;
+    };
+    std::vector<TemplateStore::Body> bodies;
+    std::vector<Counts> counts;
+    std::unordered_map<std::string_view, std::vector<std::size_t>> pattern_sources;  // -> counts
+    std::vector<std::string_view> pattern_order;
+
+    for (const auto& name : template_names) {
+        Counts c;
+        c.name = name;
+        const auto* t = store.find(name);
+        if (t) {
+            c.found = true;
+            bodies.push_back(store.open_content(*t));
+            auto body = bodies.back().view();
+            std::size_t pos = 0;
+            while (pos < body.size()) {
+                auto nl = body.find('\n', pos);
+                auto line = body.substr(pos, nl == std::string_view::npos ? std::string_view::npos : nl - pos);
+                pos = nl == std::string_view::npos ? body.size() : nl + 1;
+                c.lines++;
+                if (line.empty() || line[0] == '#') continue;
+                auto pattern = trim(line);
+                if (pattern.empty()) continue;
+                c.patterns++;
+                auto& sources = pattern_sources[pattern];
+                if (sources.empty()) pattern_order.push_back(pattern);
+                if (sources.empty() || sources.back() != counts.size()) sources.push_back(counts.size());
+            }
+        }
+        counts.push_back(std::move(c));
+    }
+
+    // Find conflicts
+    if (template_names.size() > 1) {
+        bool any = false;
+        for (auto pattern : pattern_order) {
+            const auto& sources = pattern_sources[pattern];
+            if (sources.size() < 2) continue;
+            if (!any) {
+                std::cout << color::yellow << "Potential pattern conflicts detected:" << color::reset << "\n";
+                any = true;
+            }
+            std::cout << "  " << color::cyan << pattern << color::reset << color::gray << " (from: ";
+            for (std::size_t i = 0; i < sources.size(); ++i) {
+                std::cout << counts[sources[i]].name;
+                if (i < sources.size() - 1) std::cout << ", ";
+            }
+            std::cout << ")" << color::reset << "\n";
+        }
+        if (any) std::cout << "\n";
+    }
+
+    // Show combined stats
+    std::size_t total_lines = 0;
+    std::size_t total_patterns = 0;
+    for (const auto& c : counts) {
+        if (!c.found) {
+            std::cout << color::yellow << "Warning: Template '" << c.name << "' not found" << color::reset << "\n";
+            continue;
+        }
+        total_lines += c.lines;
+        total_patterns += c.patterns;
+        if (verbose)
+            std::cout << color::cyan << c.name << color::reset << ": "
+                      << c.lines << " lines, " << c.patterns << " patterns\n";
+    }
+
+    std::cout << color::bold << "Total: " << color::reset
+              << total_lines << " lines, " << total_patterns << " ignore patterns\n";
+}
+
+std::vector<std::string> TemplateMixer::suggest_templates(const std::string& project_hint) {
+    std::vector<std::string> suggestions;
+
+    if (project_hint.empty()) {
+        // Default suggestions
+        for (const char* name : {"global", "macos", "windows", "linux"})
+            if (store.find(name)) suggestions.push_back(name);
+        return suggestions;
+    }
+
+    // Project-specific suggestions based on hint
+    auto lower = [](std::string_view v) {
+        std::string s(v);
+        for (auto& ch : s)
+            if (ch >= 'A' && ch <= 'Z') ch = char(ch - 'A' + 'a');
+        return s;
+    };
+    auto hint_lower = lower(project_hint);
+    for (const auto& tmpl : store.all()) {
+        auto name_lower = lower(tmpl.name);
+        if (hint_lower.find(name_lower) != std::string::npos ||
+            name_lower.find(hint_lower) != std::string::npos)
+            suggestions.emplace_back(tmpl.name);
+    }
+    return suggestions;
+}
+
+void TemplateMixer::show_template_statistics() {
+    const auto& templates = store.all();
+
+    if (templates.empty()) {
+        std::cout << color::yellow << "No templates available for statistics" << color::reset << "\n";
+        return;
+    }
+
+    std::size_t user_templates = 0;
+    std::size_t system_templates = 0;
+    std::size_t builtin_templates = 0;
+    std::uint64_t total_size = 0;
+
+    for (const auto& tmpl : templates) {
+        total_size += tmpl.size;
+        switch (source_of(store, tmpl)) {
+            case Source::user:    user_templates++; break;
+            case Source::system:  system_templates++; break;
+            case Source::builtin: builtin_templates++; break;
+        }
+    }
+
+    std::cout << color::bold << "Template Statistics:" << color::reset << "\n";
+    std::cout << "  Total templates: " << color::green << templates.size() << color::reset << "\n";
+    std::cout << "  User templates: " << color::blue << user_templates << color::reset << "\n";
+    std::cout << "  System templates: " << color::cyan << system_templates << color::reset << "\n";
+    std::cout << "  Built-in templates: " << color::magenta << builtin_templates << color::reset << "\n";
+    std::cout << "  Total size: " << color::yellow << format_size(total_size) << color::reset << "\n";
+
+    std::cout << "\n" << color::bold << "Template locations:" << color::reset << "\n";
+    show_locations();
+}
+
+void TemplateMixer::show_locations() {
+    auto builtin = embedded_templates().size();
+    auto print_builtin = [&] {
+        if (builtin)
+            std::cout << "  " << color::magenta << "(built-in)" << color::reset
+                      << color::gray << " (" << builtin << " templates)" << color::reset << "\n";
+    };
+    for (std::size_t i = 0; i < store.paths().size(); i++) {
+        if (i == store.builtin_position()) print_builtin();
+        const auto& path = store.paths()[i];
+        std::cout << "  " << color::cyan << path.string() << color::reset;
+        std::error_code ec;
+        if (fs::is_directory(path, ec)) {
+            auto count = std::distance(fs::directory_iterator(path, ec), fs::directory_iterator{});
+            std::cout << color::gray << " (" << count << " files)" << color::reset;
+        } else if (auto pack = TemplatePack::open(path)) {
+            std::cout << color::gray << " (pack, " << pack->size() << " templates)" << color::reset;
+        } else if (fs::exists(path, ec)) {
+            std::cout << color::yellow << " (not a template pack)" << color::reset;
+        } else {
+            std::cout << color::gray << " (not found)" << color::reset;
+        }
+        std::cout << "\n";
+    }
+    if (store.builtin_position() >= store.paths().size()) print_builtin();
+}
+
+std::vector<std::string> TemplateMixer::optimize_template_selection(std::vector<std::string> template_names) {
+    if (verbose)
+        std::cout << color::blue << "Optimizing template order..." << color::reset << "\n";
+
+    optimize_template_order(template_names);
+
+    if (verbose && template_names.size() > 1) {
+        std::cout << "Optimized order: ";
+        for (std::size_t i = 0; i < template_names.size(); ++i) {
+            std::cout << color::green << template_names[i] << color::reset;
+            if (i < template_names.size() - 1) std::cout << " → ";
+        }
+        std::cout << "\n";
+    }
+    return template_names;
+}
@@ -0,0 +1,265 @@
+#include "TemplatePack.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if __has_include(<zlib.h>) && !defined(AUTOIGNORE_NO_ZLIB)
+#define AUTOIGNORE_ZLIB 1
+#include <zlib.h>
+#endif
+
+namespace {
+
+constexpr char magic[8] = {'A', 'I', 'G', 'N', 'P', 'A', 'C', 'K'};
+constexpr std::uint32_t format_version = 1;
+constexpr std::size_t header_size = sizeof magic + 8;  // magic, version, count
+// name offset and size, headers offset and size, body offset, stored and
+// uncompressed body size, hash. A body is compressed iff it is stored
+// smaller than it is.
+constexpr std::size_t entry_size = 40;
+
+template <typename T>
+T get(const char* p) {
+    T v;
+    std::memcpy(&v, p, sizeof v);
+    return v;
+}
+
+template <typename T>
+void put(std::string& buf, T v) {
+    buf.append(reinterpret_cast<const char*>(&v), sizeof v);
+}
+
+// Lists of strings in the headers section: a u32 count, then each string
+// as a u32 size and its bytes.
+void put_list(std::string& buf, const std::vector<std::string>& items) {
+    put(buf, std::uint32_t(items.size()));
+    for (const auto& s : items) {
+        put(buf, std::uint32_t(s.size()));
+        buf += s;
+    }
+}
+
+bool get_list(std::string_view& in, std::vector<std::string_view>& out) {
+    if (in.size() < 4) return false;
+    auto n = get<std::uint32_t>(in.data());
+    in.remove_prefix(4);
+    for (std::uint32_t i = 0; i < n; i++) {
+        if (in.size() < 4) return false;
+        auto size = get<std::uint32_t>(in.data());
+        if (in.size() - 4 < size) return false;
+        out.push_back(in.substr(4, size));
+        in.remove_prefix(4 + size);
+    }
+    return true;
+}
+
+bool in_range(std::uint64_t offset, std::uint64_t size, std::size_t length) {
+    return offset <= length && size <= length - offset;
+}
+
+} // namespace
+
+struct TemplatePack::Entry {
+    std::uint32_t name_offset, name_size;
+    std::uint32_t headers_offset, headers_size;
+    std::uint64_t body_offset;
+    std::uint32_t stored_size, body_size;
+    std::uint64_t hash;
+};
+
+TemplatePack::Entry TemplatePack::entry(std::size_t i) const {
+    const char* p = data + header_size + i * entry_size;
+    Entry e;
+    e.name_offset = get<std::uint32_t>(p);
+    e.name_size = get<std::uint32_t>(p + 4);
+    e.headers_offset = get<std::uint32_t>(p + 8);
+    e.headers_size = get<std::uint32_t>(p + 12);
+    e.body_offset = get<std::uint64_t>(p + 16);
+    e.stored_size = get<std::uint32_t>(p + 24);
+    e.body_size = get<std::uint32_t>(p + 28);
+    e.hash = get<std::uint64_t>(p + 32);
+    return e;
+}
+
+std::unique_ptr<TemplatePack> TemplatePack::open(const fs::path& file) {
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || std::size_t(st.st_size) < header_size) {
+        close(fd);
+        return nullptr;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return nullptr;
+
+    std::unique_ptr<TemplatePack> pack(new TemplatePack);
+    pack->data = static_cast<const char*>(map);
+    pack->length = st.st_size;
+    if (std::memcmp(pack->data, magic, sizeof magic) != 0 ||
+        get<std::uint32_t>(pack->data + sizeof magic) != format_version)
+        return nullptr;
+    std::uint64_t n = get<std::uint32_t>(pack->data + sizeof magic + 4);
+    if (n > (pack->length - header_size) / entry_size) return nullptr;
+    pack->count = n;
+
+    // Every range is checked here, and the order binary search relies on,
+    // so that lookups need no checks.
+    for (std::size_t i = 0; i < pack->count; i++) {
+        auto e = pack->entry(i);
+        if (!in_range(e.name_offset, e.name_size, pack->length) ||
+            !in_range(e.headers_offset, e.headers_size, pack->length) ||
+            !in_range(e.body_offset, e.stored_size, pack->length) || e.stored_size > e.body_size)
+            return nullptr;
+        if (i > 0 && !(pack->name(i - 1) < pack->name(i))) return nullptr;
+    }
+    return pack;
+}
+
+TemplatePack::~TemplatePack() {
+    if (data) munmap(const_cast<char*>(data), length);
+}
+
+std::string_view TemplatePack::name(std::size_t i) const {
+    auto e = entry(i);
+    return std::string_view(data + e.name_offset, e.name_size);
+}
+
+std::uint64_t TemplatePack::hash(std::size_t i) const {
+    return entry(i).hash;
+}
+
+std::uint64_t TemplatePack::body_size(std::size_t i) const {
+    return entry(i).body_size;
+}
+
+bool TemplatePack::compressed(std::size_t i) const {
+    auto e = entry(i);
+    return e.stored_size < e.body_size;
+}
+
+void TemplatePack::headers(std::size_t i, std::vector<std::string_view>& detect_patterns,
+                           std::vector<std::string_view>& content_rules) const {
+    auto e = entry(i);
+    std::string_view in(data + e.headers_offset, e.headers_size);
+    if (get_list(in, detect_patterns)) get_list(in, content_rules);
+}
+
+std::size_t TemplatePack::lower_bound(std::string_view key) const {
+    std::size_t lo = 0, hi = count;
+    while (lo < hi) {
+        auto mid = lo + (hi - lo) / 2;
+        if (name(mid) < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+std::size_t TemplatePack::find(std::string_view key) const {
+    auto i = lower_bound(key);
+    return i < count && name(i) == key ? i : count;
+}
+
+std::string_view TemplatePack::body(std::size_t i, std::unique_ptr<char[]>& buffer) const {
+    auto e = entry(i);
+    std::string_view stored(data + e.body_offset, e.stored_size);
+    if (e.stored_size == e.body_size) return stored;
+#ifdef AUTOIGNORE_ZLIB
+    buffer = std::make_unique<char[]>(e.body_size);
+    uLongf size = e.body_size;
+    if (uncompress(reinterpret_cast<Bytef*>(buffer.get()), &size,
+                   reinterpret_cast<const Bytef*>(stored.data()), stored.size()) == Z_OK &&
+        size == e.body_size)
+        return std::string_view(buffer.get(), size);
+    buffer.reset();
+#else
+    (void)buffer;
+#endif
+    return {};
+}
+
+bool TemplatePack::compression_supported() {
+#ifdef AUTOIGNORE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool TemplatePack::write(const fs::path& file, std::vector<Source> templates, bool compress) {
+    std::sort(templates.begin(), templates.end(),
+              [](const Source& a, const Source& b) { return a.name < b.name; });
+
+    // Names and headers follow the table, so their offsets are known
+    // before the bodies are.
+    std::size_t strings_start = header_size + templates.size() * entry_size;
+    std::string strings;
+    std::vector<std::uint32_t> name_offsets, headers_offsets, headers_sizes;
+    for (std::size_t i = 0; i < templates.size(); i++) {
+        const auto& t = templates[i];
+        if ((i > 0 && templates[i - 1].name == t.name) || t.body.size() > UINT32_MAX) return false;
+        name_offsets.push_back(std::uint32_t(strings_start + strings.size()));
+        strings += t.name;
+        headers_offsets.push_back(std::uint32_t(strings_start + strings.size()));
+        put_list(strings, t.detect_patterns);
+        put_list(strings, t.content_rules);
+        headers_sizes.push_back(std::uint32_t(strings_start + strings.size() - headers_offsets.back()));
+        if (strings_start + strings.size() > UINT32_MAX) return false;
+    }
+
+    std::string buf(magic, sizeof magic);
+    put(buf, format_version);
+    put(buf, std::uint32_t(templates.size()));
+    std::string bodies;
+    std::uint64_t bodies_start = strings_start + strings.size();
+    for (std::size_t i = 0; i < templates.size(); i++) {
+        const auto& t = templates[i];
+        std::string_view stored = t.body;
+#ifdef AUTOIGNORE_ZLIB
+        std::string deflated;
+        if (compress && !t.body.empty()) {
+            uLongf size = compressBound(t.body.size());
+            deflated.resize(size);
+            if (compress2(reinterpret_cast<Bytef*>(deflated.data()), &size,
+                          reinterpret_cast<const Bytef*>(t.body.data()), t.body.size(), Z_BEST_COMPRESSION) == Z_OK &&
+                size < t.body.size())
+                stored = std::string_view(deflated).substr(0, size);
+        }
+#else
+        if (compress) return false;
+#endif
+        put(buf, name_offsets[i]);
+        put(buf, std::uint32_t(t.name.size()));
+        put(buf, headers_offsets[i]);
+        put(buf, headers_sizes[i]);
+        put(buf, bodies_start + bodies.size());
+        put(buf, std::uint32_t(stored.size()));
+        put(buf, std::uint32_t(t.body.size()));
+        put(buf, t.hash);
+        bodies += stored;
+    }
+    buf += strings;
+    buf += bodies;
+
+    std::error_code ec;
+    if (file.has_parent_path()) fs::create_directories(file.parent_path(), ec);
+    auto tmp = file;
+    tmp += ".tmp." + std::to_string(getpid());
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    std::size_t done = 0;
+    while (done < buf.size()) {
+        auto n = ::write(fd, buf.data() + done, buf.size() - done);
+        if (n <= 0) break;
+        done += n;
+    }
+    bool ok = close(fd) == 0 && done == buf.size();
+    if (ok) ok = rename(tmp.c_str(), file.c_str()) == 0;
+    if (!ok) unlink(tmp.c_str());
+    return ok;
+}
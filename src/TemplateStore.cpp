@@ -1,95 +1,519 @@
 #include "TemplateStore.hpp"
+#include "EmbeddedTemplates.hpp"
+#include "Stats.hpp"
 
 #include <algorithm>
+#include <bit>
+#include <cerrno>
 #include <fstream>
 #include <sstream>
 #include <unordered_map>
 #include <cstdlib>
+#include <utility>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 TemplateStore::TemplateStore() {
     init_paths();
 }
 
 void TemplateStore::init_paths() {
+    if (const char* extra = std::getenv("AUTOIGNORE_PATH")) {
+        for (std::string_view list = extra; !list.empty();) {
+            auto colon = list.find(':');
+            if (colon != 0) search_paths.emplace_back(list.substr(0, colon));
+            list = colon == std::string_view::npos ? std::string_view{} : list.substr(colon + 1);
+        }
+    }
     if (const char* home = std::getenv("HOME")) {
         search_paths.push_back(fs::path(home) / ".local/share/autoignore/template");
     }
+    user_count = search_paths.size();
     search_paths.push_back("/usr/local/share/autoignore/template");
+    // The built-in copy of the bundled templates takes the place of the
+    // installed one, so the common case needs no template file I/O.
+    builtin_pos = search_paths.size();
     search_paths.push_back("/usr/share/autoignore/template");
 }
 
-std::vector<std::string> TemplateStore::parse_detect_patterns(const fs::path& path) {
-    std::ifstream f(path);
-    std::vector<std::string> patterns;
-    std::string line;
-    while (std::getline(f, line)) {
+std::uint64_t TemplateStore::content_hash(std::string_view content, std::uint64_t h) {
+    for (unsigned char c : content) {
+        h ^= c;
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+// Reads the header and hashes the whole file; templates are small, so one
+// read of each changed file serves both. The headers are interned.
+void TemplateStore::parse_header(const fs::path& path, TemplateIndex::File& f) {
+    Stats::count(Stats::headers_parsed);
+    std::ifstream file(path, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    f.hash = content_hash(content);
+    intern_header(content, f);
+}
+
+void TemplateStore::intern_header(std::string_view content, TemplateIndex::File& f) {
+    std::vector<std::string> detect_patterns, content_rules;
+    parse_header(content, detect_patterns, content_rules);
+    for (const auto& p : detect_patterns) f.detect_patterns.push_back(pool[pool.intern(p)]);
+    for (const auto& rule : content_rules) f.content_rules.push_back(pool[pool.intern(rule)]);
+}
+
+void TemplateStore::parse_header(std::string_view content, std::vector<std::string>& detect_patterns,
+                                 std::vector<std::string>& content_rules) {
+    for (std::size_t pos = 0; pos < content.size();) {
+        auto nl = content.find('\n', pos);
+        auto line = content.substr(pos, nl == std::string_view::npos ? std::string_view::npos : nl - pos);
+        pos = nl == std::string_view::npos ? content.size() : nl + 1;
         if (line.empty()) break;
-        if (line.rfind("# @detect:", 0) == 0) {
-            std::istringstream ss(line.substr(10));
+        if (line.starts_with("# @detect:")) {
+            std::istringstream ss{std::string(line.substr(10))};
             std::string token;
-            while (ss >> token) patterns.push_back(token);
+            while (ss >> token) detect_patterns.push_back(token);
+        } else if (line.starts_with("# @content:")) {
+            auto begin = line.find_first_not_of(" \t", 11);
+            auto end = line.find_last_not_of(" \t\r");
+            if (begin != std::string_view::npos) content_rules.emplace_back(line.substr(begin, end + 1 - begin));
         } else if (line[0] != '#') {
             break;
         }
     }
-    return patterns;
+}
+
+namespace {
+
+std::int64_t mtime_ns(const struct stat& st) {
+    return std::int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+// The lines of a file up to and including the first that ends its header,
+// as far as parse_header() reads, without reading the rest.
+std::string read_header_lines(const char* path) {
+    std::string head;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return head;
+    char buf[4096];
+    std::size_t line = 0;
+    for (ssize_t n; (n = read(fd, buf, sizeof buf)) > 0;) {
+        head.append(buf, n);
+        for (std::size_t nl; (nl = head.find('\n', line)) != std::string::npos; line = nl + 1) {
+            if (nl == line || head[line] != '#') {
+                head.resize(nl + 1);
+                close(fd);
+                return head;
+            }
+        }
+    }
+    close(fd);
+    return head;
+}
+
+// Whether every indexed file of `dir` still has the size and mtime it was
+// indexed with. Rewriting a template in place leaves the directory's mtime
+// alone, so that alone does not make its records current.
+bool files_unchanged(const fs::path& dir, const std::vector<TemplateIndex::File>& files) {
+    if (files.empty()) return true;
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    std::string name;
+    bool same = true;
+    for (const auto& f : files) {
+        name.assign(f.name).append(".gitignore");
+        struct stat st;
+        if (fstatat(fd, name.c_str(), &st, 0) != 0 || std::uint64_t(st.st_size) != f.size ||
+            mtime_ns(st) != f.mtime) {
+            same = false;
+            break;
+        }
+    }
+    close(fd);
+    return same;
+}
+
+} // namespace
+
+template <typename Strings>
+std::span<const StringPool::Id> TemplateStore::intern(const Strings& items) {
+    auto ids = pool.allocate<StringPool::Id>(std::size(items));
+    std::size_t i = 0;
+    for (const auto& s : items) ids[i++] = pool.intern(s);
+    return ids;
+}
+
+// Built-in names and bodies stay in the executable, and packed ones in the
+// pack; only file templates have their name and path copied.
+TemplateStore::Template TemplateStore::builtin_template(const EmbeddedTemplate& e) {
+    Template t;
+    t.name = e.name;
+    t.size = e.content.size();
+    t.detect_patterns = intern(std::span(e.detect_patterns, e.detect_count));
+    t.content_rules = intern(std::span(e.content_rules, e.content_count));
+    t.hash = e.hash;
+    t.builtin = e.content;
+    return t;
+}
+
+TemplateStore::Template TemplateStore::packed_template(std::size_t dir, std::size_t entry) {
+    const auto& pack = *packs[dir];
+    Template t;
+    t.name = pack.name(entry);
+    t.path = search_paths[dir].native();
+    t.size = pack.body_size(entry);
+    std::vector<std::string_view> detect_patterns, content_rules;
+    pack.headers(entry, detect_patterns, content_rules);
+    t.detect_patterns = intern(detect_patterns);
+    t.content_rules = intern(content_rules);
+    t.hash = pack.hash(entry);
+    t.pack = &pack;
+    t.pack_entry = std::uint32_t(entry);
+    t.dir = std::uint32_t(dir);
+    return t;
+}
+
+TemplateStore::Template TemplateStore::file_template(std::size_t dir, const TemplateIndex::File& f) {
+    Template t;
+    std::string_view dir_path = search_paths[dir].native();
+    std::string_view sep = dir_path.ends_with('/') ? "" : "/";
+    t.path = pool.store({dir_path, sep, f.name, ".gitignore"});
+    t.name = t.path.substr(dir_path.size() + sep.size(), f.name.size());
+    t.dir = std::uint32_t(dir);
+    t.size = f.size;
+    t.mtime = f.mtime;
+    t.detect_patterns = intern(f.detect_patterns);
+    t.content_rules = intern(f.content_rules);
+    t.hash = f.hash;
+    return t;
+}
+
+void TemplateStore::scan_dir(TemplateIndex::Dir& dir, const TemplateIndex::Dir* previous) {
+    StatsPhase phase("store.scan_dir");
+    Stats::count(Stats::template_dirs_scanned);
+    std::unordered_map<std::string_view, const TemplateIndex::File*> known;
+    if (previous)
+        for (const auto& f : previous->files) known.emplace(f.name, &f);
+
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir.path, ec)) {
+        auto fname = entry.path().filename().string();
+        if (!fname.ends_with(".gitignore")) continue;
+        struct stat st;
+        if (stat(entry.path().c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+        TemplateIndex::File f;
+        f.name = pool.store(std::string_view(fname).substr(0, fname.size() - 10));
+        f.size = st.st_size;
+        f.mtime = mtime_ns(st);
+        auto it = known.find(f.name);
+        if (it != known.end() && it->second->size == f.size && it->second->mtime == f.mtime) {
+            f.detect_patterns = it->second->detect_patterns;
+            f.content_rules = it->second->content_rules;
+            f.hash = it->second->hash;
+        } else {
+            parse_header(entry.path(), f);
+        }
+        dir.files.push_back(std::move(f));
+    }
+    std::sort(dir.files.begin(), dir.files.end(),
+              [](const TemplateIndex::File& a, const TemplateIndex::File& b) { return a.name < b.name; });
 }
 
 const std::vector<TemplateStore::Template>& TemplateStore::all() {
     if (cache_valid) return cache;
+    StatsPhase phase("store.load");
     cache.clear();
-    std::unordered_map<std::string, Template> seen;
-    for (const auto& base : search_paths) {
-        if (!fs::exists(base) || !fs::is_directory(base)) continue;
-        for (const auto& entry : fs::directory_iterator(base)) {
-            if (!entry.is_regular_file()) continue;
-            auto fname = entry.path().filename().string();
-            if (!fname.ends_with(".gitignore")) continue;
-            std::string name = fname.substr(0, fname.size() - 10);
-            if (!seen.count(name)) {
-                Template t;
-                t.name = name;
-                t.path = entry.path();
-                t.detect_patterns = parse_detect_patterns(entry.path());
-                seen.emplace(name, std::move(t));
+    slots.clear();
+    search_index.reset();
+    // Packs opened by find() are kept: reload() drops them all.
+    packs.resize(search_paths.size());
+
+    // The records of the index view its mapping, and unchanged ones are
+    // carried over to the index written back.
+    auto index_file = TemplateIndex::default_location();
+    std::unique_ptr<TemplateIndex> index;
+    {
+        StatsPhase read("store.index_read");
+        index = std::make_unique<TemplateIndex>(index_file);
+    }
+    auto& previous = index->dirs();
+    bool dirty = previous.size() != search_paths.size();
+
+    std::vector<TemplateIndex::Dir> dirs(search_paths.size());
+    for (std::size_t i = 0; i < search_paths.size(); i++) {
+        auto& d = dirs[i];
+        d.path = search_paths[i];
+        struct stat st;
+        bool found = stat(d.path.c_str(), &st) == 0;
+        // The mtime is taken before listing, so changes made while the
+        // directory is scanned invalidate the index on the next run.
+        if (found && S_ISDIR(st.st_mode)) {
+            d.exists = true;
+            d.mtime = mtime_ns(st);
+        } else if (found && S_ISREG(st.st_mode)) {
+            // A pack is an index of its own; the index records it as a
+            // missing directory.
+            StatsPhase open("store.pack_open");
+            if (!packs[i]) packs[i] = TemplatePack::open(d.path);
+        }
+        const TemplateIndex::Dir* prev =
+            i < previous.size() && previous[i].path == d.path ? &previous[i] : nullptr;
+        if (prev && prev->exists == d.exists && prev->mtime == d.mtime &&
+            (!d.exists || files_unchanged(d.path, prev->files))) {
+            d.files = std::move(previous[i].files);
+            continue;
+        }
+        dirty = true;
+        if (d.exists) scan_dir(d, prev);
+    }
+    if (dirty && !index_file.empty()) {
+        StatsPhase write("store.index_write");
+        TemplateIndex::save(index_file, dirs);
+    }
+
+    // Built-ins, packs and directories are each sorted by name, so the
+    // catalogue is a merge of them in search order: of equal names, the
+    // first source's wins and the others are skipped.
+    struct Source {
+        std::size_t dir;  // search path, or dirs.size() for the built-ins
+        std::size_t next = 0, end;
+    };
+    std::vector<Source> sources;
+    auto builtins = embedded_templates();
+    std::size_t total = 0;
+    for (std::size_t i = 0; i <= dirs.size(); i++) {
+        if (i == std::min(builtin_pos, dirs.size())) sources.push_back({dirs.size(), 0, builtins.size()});
+        if (i == dirs.size()) break;
+        if (packs[i]) sources.push_back({i, 0, packs[i]->size()});
+        else if (!dirs[i].files.empty()) sources.push_back({i, 0, dirs[i].files.size()});
+    }
+    for (const auto& s : sources) total += s.end;
+    auto head = [&](const Source& s) -> std::string_view {
+        if (s.dir == dirs.size()) return builtins[s.next].name;
+        if (packs[s.dir]) return packs[s.dir]->name(s.next);
+        return dirs[s.dir].files[s.next].name;
+    };
+    cache.reserve(total);
+    for (;;) {
+        Source* best = nullptr;
+        std::string_view name;
+        for (auto& s : sources) {
+            if (s.next == s.end) continue;
+            if (auto n = head(s); !best || n < name) {
+                best = &s;
+                name = n;
             }
         }
+        if (!best) break;
+        if (best->dir == dirs.size()) cache.push_back(builtin_template(builtins[best->next]));
+        else if (packs[best->dir]) cache.push_back(packed_template(best->dir, best->next));
+        else cache.push_back(file_template(best->dir, dirs[best->dir].files[best->next]));
+        for (auto& s : sources)
+            if (s.next < s.end && head(s) == name) s.next++;
     }
-    for (auto& [k, v] : seen) cache.push_back(std::move(v));
-    std::sort(cache.begin(), cache.end(),
-              [](const Template& a, const Template& b) { return a.name < b.name; });
+    index_names();
     cache_valid = true;
+    Stats::count(Stats::templates, cache.size());
     return cache;
 }
 
+// Open addressing over positions in `cache`, at most half full.
+void TemplateStore::index_names() {
+    slots.assign(std::bit_ceil(std::max<std::size_t>(2 * cache.size(), 16)), empty_slot);
+    for (std::size_t j = 0; j < cache.size(); j++) {
+        auto i = slot(cache[j].name);
+        while (slots[i] != empty_slot) i = (i + 1) & (slots.size() - 1);
+        slots[i] = std::uint32_t(j);
+    }
+}
+
+std::size_t TemplateStore::slot(std::string_view name) const {
+    return std::hash<std::string_view>{}(name) & (slots.size() - 1);
+}
+
+std::uint64_t TemplateStore::current_hash(const Template& t, const Body* body) {
+    if (t.pack || t.path.empty()) return t.hash;
+    struct stat st;
+    bool unchanged = stat(t.path.data(), &st) == 0 && std::uint64_t(st.st_size) == t.size &&
+                     mtime_ns(st) == t.mtime;
+    if (unchanged && t.hashed) return t.hash;
+    if (unchanged && !body) {
+        if (!index) index = std::make_unique<TemplateIndex>(TemplateIndex::default_location());
+        if (const auto* f = index->find(t.path); f && f->size == t.size && f->mtime == t.mtime) return f->hash;
+    }
+    if (body) return content_hash(body->view());
+    return content_hash(open_content(t).view());
+}
+
 const TemplateStore::Template* TemplateStore::find(const std::string& name) {
-    all();
-    for (const auto& t : cache) {
-        if (t.name == name) return &t;
+    if (cache_valid) {
+        for (auto i = slot(name);; i = (i + 1) & (slots.size() - 1)) {
+            if (slots[i] == empty_slot) return nullptr;
+            if (cache[slots[i]].name == name) return &cache[slots[i]];
+        }
+    }
+    if (auto it = probed.find(name); it != probed.end()) return &it->second;
+    return probe(name);
+}
+
+// One stat per directory until the template turns up; a search path that
+// turns out to be a file is opened as a pack. Misses are not remembered.
+const TemplateStore::Template* TemplateStore::probe(const std::string& name) {
+    if (name.empty() || name.find('/') != std::string::npos) return nullptr;
+    StatsPhase phase("store.probe");
+    auto builtin = [&]() -> const Template* {
+        auto table = embedded_templates();
+        auto it = std::lower_bound(table.begin(), table.end(), std::string_view(name),
+                                   [](const EmbeddedTemplate& e, std::string_view n) { return e.name < n; });
+        if (it == table.end() || it->name != name) return nullptr;
+        auto t = builtin_template(*it);
+        return &probed.emplace(t.name, t).first->second;
+    };
+    packs.resize(search_paths.size());
+    for (std::size_t i = 0; i < search_paths.size(); i++) {
+        if (i == builtin_pos)
+            if (const auto* t = builtin()) return t;
+        if (!packs[i]) {
+            auto file = search_paths[i] / (name + ".gitignore");
+            struct stat st;
+            if (stat(file.c_str(), &st) == 0) {
+                if (!S_ISREG(st.st_mode)) continue;
+                // Only the header: the hash is left to current_hash().
+                TemplateIndex::File f;
+                f.name = name;
+                f.size = st.st_size;
+                f.mtime = mtime_ns(st);
+                Stats::count(Stats::headers_parsed);
+                intern_header(read_header_lines(file.c_str()), f);
+                auto t = file_template(i, f);
+                t.hashed = false;
+                return &probed.emplace(t.name, t).first->second;
+            }
+            if (errno != ENOTDIR || !(packs[i] = TemplatePack::open(search_paths[i]))) continue;
+        }
+        if (auto j = packs[i]->find(name); j < packs[i]->size()) {
+            auto t = packed_template(i, j);
+            return &probed.emplace(t.name, t).first->second;
+        }
     }
-    return nullptr;
+    return builtin_pos >= search_paths.size() ? builtin() : nullptr;
 }
 
 std::vector<const TemplateStore::Template*> TemplateStore::search(const std::string& query) {
     all();
-    std::string q = query;
-    std::transform(q.begin(), q.end(), q.begin(), ::tolower);
-    std::vector<const Template*> results;
-    for (const auto& t : cache) {
-        std::string n = t.name;
-        std::transform(n.begin(), n.end(), n.begin(), ::tolower);
-        if (n.find(q) != std::string::npos) results.push_back(&t);
+    if (!search_index) {
+        std::vector<std::string> names;
+        names.reserve(cache.size());
+        for (const auto& t : cache) names.emplace_back(t.name);
+        search_index = std::make_unique<SearchIndex>(names);
     }
+    std::vector<const Template*> results;
+    for (const auto& hit : search_index->query(query)) results.push_back(&cache[hit.id]);
     return results;
 }
 
 std::string TemplateStore::read_content(const Template& t) const {
-    std::ifstream f(t.path);
+    if (t.path.empty() || t.pack) return std::string(open_content(t).view());
+    std::ifstream f(t.path.data());
     if (!f) return "";
     return std::string((std::istreambuf_iterator<char>(f)),
                         std::istreambuf_iterator<char>());
 }
 
+std::string TemplateStore::read_header(const Template& t, std::size_t limit) const {
+    std::string head;
+    if (t.path.empty() || t.pack) {
+        head = open_content(t).view().substr(0, limit);
+    } else {
+        int fd = open(t.path.data(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return head;
+        head.resize(limit);
+        std::size_t got = 0;
+        while (got < limit) {
+            auto n = read(fd, head.data() + got, limit - got);
+            if (n <= 0) break;
+            got += n;
+        }
+        close(fd);
+        head.resize(got);
+    }
+    // Drop a line cut off by the limit.
+    if (head.size() == limit) head.resize(head.rfind('\n') + 1);
+    return head;
+}
+
+TemplateStore::Body::Body(Body&& other) noexcept
+    : data(other.data), map(other.map), file(other.file), inflated(std::move(other.inflated))
+{
+    other.data = {};
+    other.map = nullptr;
+    other.file = -1;
+}
+
+TemplateStore::Body& TemplateStore::Body::operator=(Body&& other) noexcept {
+    std::swap(data, other.data);
+    std::swap(map, other.map);
+    std::swap(file, other.file);
+    std::swap(inflated, other.inflated);
+    return *this;
+}
+
+TemplateStore::Body::~Body() {
+    if (map) munmap(map, data.size());
+    if (file >= 0) close(file);
+}
+
+TemplateStore::Body TemplateStore::open_content(const Template& t) const {
+    Body b;
+    if (t.path.empty()) {
+        b.data = t.builtin;
+        return b;
+    }
+    if (t.pack) {
+        b.data = t.pack->body(t.pack_entry, b.inflated);
+        return b;
+    }
+    b.file = open(t.path.data(), O_RDONLY | O_CLOEXEC);
+    if (b.file < 0) return b;
+    struct stat st;
+    if (fstat(b.file, &st) != 0 || st.st_size == 0) return b;
+    void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, b.file, 0);
+    if (m == MAP_FAILED) return b;
+    b.map = m;
+    b.data = std::string_view(static_cast<const char*>(m), st.st_size);
+    return b;
+}
+
+std::vector<std::string> TemplateStore::names(std::string_view prefix) const {
+    constexpr std::string_view suffix = ".gitignore";
+    std::vector<std::string> out;
+    for (const auto& e : embedded_templates())
+        if (e.name.starts_with(prefix)) out.emplace_back(e.name);
+    for (const auto& dir : search_paths) {
+        DIR* d = opendir(dir.c_str());
+        if (!d && errno == ENOTDIR) {
+            if (auto pack = TemplatePack::open(dir)) {
+                for (auto i = pack->lower_bound(prefix); i < pack->size() && pack->name(i).starts_with(prefix); i++)
+                    out.emplace_back(pack->name(i));
+            }
+        }
+        if (!d) continue;
+        while (const dirent* ent = readdir(d)) {
+            std::string_view name = ent->d_name;
+            if (ent->d_type == DT_DIR || name.size() <= suffix.size() || !name.ends_with(suffix)) continue;
+            name.remove_suffix(suffix.size());
+            if (name.starts_with(prefix)) out.emplace_back(name);
+        }
+        closedir(d);
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+}
+
 const std::vector<fs::path>& TemplateStore::paths() const {
     return search_paths;
 }
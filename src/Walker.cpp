@@ -0,0 +1,267 @@
+#include "Walker.hpp"
+#include "Generator.hpp"
+#include "IgnoreMatcher.hpp"
+#include "Stats.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+constexpr unsigned max_default_threads = 8;
+constexpr std::size_t dirent_buffer_size = 32 * 1024;
+
+// The patterns of one .gitignore, chained to those of the directories
+// above it. Deeper files take precedence.
+struct IgnoreLevel {
+    IgnoreMatcher matcher;
+    std::string base;  // directory holding the file, relative to the root
+    std::shared_ptr<const IgnoreLevel> parent;
+};
+
+struct Item {
+    std::string rel;  // directory path relative to the root, "" for the root
+    int depth;        // depth of the entries inside this directory
+    std::uintptr_t tag;
+    std::shared_ptr<const IgnoreLevel> ignore;
+};
+
+// Reads the hand-written part of dir_fd/.gitignore into a new level, or
+// returns parent if there is none.
+std::shared_ptr<const IgnoreLevel> load_gitignore(int dir_fd, const std::string& rel,
+                                                  std::shared_ptr<const IgnoreLevel> parent)
+{
+    int fd = openat(dir_fd, ".gitignore", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return parent;
+    std::string content;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        content.resize(st.st_size);
+        std::size_t got = 0;
+        while (got < content.size()) {
+            auto n = read(fd, content.data() + got, content.size() - got);
+            if (n <= 0) break;
+            got += n;
+        }
+        content.resize(got);
+    }
+    close(fd);
+    Stats::count(Stats::bytes_read, content.size());
+
+    auto level = std::make_shared<IgnoreLevel>();
+    level->matcher.add(Generator::hand_written(content), rel.empty() ? ".gitignore" : rel + "/.gitignore");
+    if (level->matcher.size() == 0) return parent;
+    level->base = rel;
+    level->parent = std::move(parent);
+    return level;
+}
+
+// Whether the innermost .gitignore with a matching rule ignores the
+// directory `rel`. Parents are never ignored, or the walk would not be here.
+bool ignored_dir(const IgnoreLevel* level, std::string_view rel) {
+    for (; level; level = level->parent.get()) {
+        auto sub = level->base.empty() ? rel : rel.substr(level->base.size() + 1);
+        int r = level->matcher.match(sub, true);
+        if (r >= 0) return level->matcher.ignores(r);
+    }
+    return false;
+}
+
+struct Queue {
+    std::mutex m;
+    std::deque<Item> items;
+};
+
+#ifdef __linux__
+// Fixed prefix of struct linux_dirent64; the NUL-terminated name follows.
+struct Dirent64 {
+    std::uint64_t ino;
+    std::int64_t off;
+    unsigned short reclen;
+    unsigned char type;
+};
+constexpr std::size_t dirent_name_offset = offsetof(Dirent64, type) + 1;
+#endif
+
+// Calls f(name, d_type) for every entry of the directory until f returns
+// false, then closes fd.
+template <typename F>
+void read_dir(int fd, std::vector<char>& buf, F&& f) {
+#ifdef __linux__
+    for (;;) {
+        long n = syscall(SYS_getdents64, fd, buf.data(), buf.size());
+        if (n <= 0) break;
+        for (long off = 0; off < n;) {
+            Dirent64 d;
+            std::memcpy(&d, buf.data() + off, sizeof d);
+            if (!f(std::string_view(buf.data() + off + dirent_name_offset), d.type)) {
+                close(fd);
+                return;
+            }
+            off += d.reclen;
+        }
+    }
+    close(fd);
+#else
+    DIR* d = fdopendir(fd);
+    if (!d) { close(fd); return; }
+    while (auto* e = readdir(d))
+        if (!f(std::string_view(e->d_name), e->d_type)) break;
+    closedir(d);
+#endif
+}
+
+class Pool {
+public:
+    Pool(int root_fd, unsigned threads, const WalkOptions& opts,
+         const Walker::Visitor& visit, const std::atomic<bool>& stopped)
+        : root_fd(root_fd), opts(opts), visit(visit), stopped(stopped), queues(threads) {}
+
+    void run(unsigned worker) {
+        std::vector<char> buf(dirent_buffer_size);
+        Item item;
+        unsigned idle = 0;
+        while (true) {
+            if (pop(worker, item) || steal(worker, item)) {
+                process(worker, item, buf);
+                pending.fetch_sub(1, std::memory_order_acq_rel);
+                idle = 0;
+                continue;
+            }
+            if (pending.load(std::memory_order_acquire) == 0) return;
+            if (++idle < 64) std::this_thread::yield();
+            else std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+    void push(unsigned worker, Item item) {
+        pending.fetch_add(1, std::memory_order_acq_rel);
+        std::lock_guard lock(queues[worker].m);
+        queues[worker].items.push_back(std::move(item));
+    }
+
+private:
+    int root_fd;
+    const WalkOptions& opts;
+    const Walker::Visitor& visit;
+    const std::atomic<bool>& stopped;
+    std::vector<Queue> queues;
+    std::atomic<std::size_t> pending{0};
+
+    bool pruned(std::string_view name) const {
+        return !opts.prune.empty() && std::binary_search(opts.prune.begin(), opts.prune.end(), name, std::less<>());
+    }
+
+    bool pop(unsigned worker, Item& out) {
+        auto& q = queues[worker];
+        std::lock_guard lock(q.m);
+        if (q.items.empty()) return false;
+        out = std::move(q.items.back());
+        q.items.pop_back();
+        return true;
+    }
+
+    bool steal(unsigned worker, Item& out) {
+        for (std::size_t i = 1; i < queues.size(); i++) {
+            auto& q = queues[(worker + i) % queues.size()];
+            std::lock_guard lock(q.m);
+            if (q.items.empty()) continue;
+            out = std::move(q.items.front());
+            q.items.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void process(unsigned worker, const Item& item, std::vector<char>& buf) {
+        if (stopped.load(std::memory_order_relaxed)) return;
+        int fd = openat(root_fd, item.rel.empty() ? "." : item.rel.c_str(),
+                        O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) return;
+        if (opts.on_open) opts.on_open(item.rel);
+        bool descend_ok = opts.max_depth < 0 || item.depth < opts.max_depth;
+        auto ignore = opts.gitignore && descend_ok ? load_gitignore(fd, item.rel, item.ignore) : nullptr;
+        // Counted here and handed to Stats once per directory.
+        std::uint64_t seen = 0, skipped = 0;
+        read_dir(fd, buf, [&](std::string_view name, unsigned char type) {
+            if (stopped.load(std::memory_order_relaxed)) return false;
+            if (name == "." || name == "..") return true;
+            if (opts.skip_hidden && name[0] == '.') return true;
+            bool is_dir = type == DT_DIR;
+            if (type == DT_UNKNOWN) {
+                struct stat st;
+                std::string rel = item.rel.empty() ? std::string(name) : item.rel + "/" + std::string(name);
+                is_dir = fstatat(root_fd, rel.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+            }
+            std::uint64_t size = 0;
+            if (opts.stat_files && !is_dir) {
+                struct stat st;
+                if (fstatat(fd, name.data(), &st, AT_SYMLINK_NOFOLLOW) == 0) size = st.st_size;
+            }
+            Walker::Entry entry{name, item.rel, item.depth, is_dir, size, item.tag};
+            seen++;
+            bool descend = visit(worker, entry);
+            if (is_dir && descend && descend_ok) {
+                if (pruned(name)) {
+                    skipped++;
+                    return true;
+                }
+                std::string rel = item.rel;
+                if (!rel.empty()) rel += '/';
+                rel += name;
+                if (!ignore || !ignored_dir(ignore.get(), rel))
+                    push(worker, Item{std::move(rel), item.depth + 1, entry.tag, ignore});
+                else
+                    skipped++;
+            }
+            return true;
+        });
+        if (Stats::current()) {
+            Stats::count(Stats::dirs_opened);
+            Stats::count(Stats::entries, seen);
+            Stats::count(Stats::entries_pruned, skipped);
+        }
+    }
+};
+
+} // namespace
+
+Walker::Walker(WalkOptions opts) : opts(std::move(opts)) {
+    std::sort(this->opts.prune.begin(), this->opts.prune.end());
+    threads = this->opts.threads;
+    if (threads == 0) threads = std::min(std::max(1u, std::thread::hardware_concurrency()), max_default_threads);
+}
+
+void Walker::walk(const std::filesystem::path& root, const Visitor& visit, std::uintptr_t root_tag) {
+    int root_fd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0) return;
+
+    stopped.store(false, std::memory_order_relaxed);
+    Pool pool(root_fd, threads, opts, visit, stopped);
+    pool.push(0, Item{"", 0, root_tag, nullptr});
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; i++)
+        workers.emplace_back([&pool, i] { pool.run(i); });
+    pool.run(0);
+    for (auto& t : workers) t.join();
+
+    close(root_fd);
+}
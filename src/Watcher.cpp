@@ -0,0 +1,355 @@
+#include "Watcher.hpp"
+#include "Common.hpp"
+#include "EmbeddedTemplates.hpp"
+#include "Generator.hpp"
+#include "PrefixReader.hpp"
+#include "Walker.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr std::uint32_t watch_mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                     IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF;
+// Events closer together than this are handled as one change.
+constexpr int settle_ms = 100;
+// Time between full walks once the watch limit has run out.
+constexpr int poll_interval_ms = 2000;
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void on_stop_signal(int) { stop_requested = 1; }
+
+std::string join(std::string_view dir, std::string_view name) {
+    std::string path(dir);
+    if (!path.empty() && !name.empty()) path += '/';
+    path += name;
+    return path;
+}
+
+std::string_view base_name(std::string_view path) {
+    auto slash = path.rfind('/');
+    return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+int components(std::string_view path) {
+    return path.empty() ? 0 : int(std::count(path.begin(), path.end(), '/')) + 1;
+}
+
+} // namespace
+
+Watcher::Watcher(TemplateStore& store, DetectOptions opts)
+    : templates(store.all()), opts(std::move(opts)), matcher(templates, store.strings()), max_depth(WalkOptions{}.max_depth)
+{
+    prune = this->opts.prune;
+    if (this->opts.prune_defaults)
+        for (auto name : default_prune_dirs()) prune.emplace_back(name);
+    std::sort(prune.begin(), prune.end());
+}
+
+Watcher::~Watcher() {
+    if (inotify_fd >= 0) close(inotify_fd);
+}
+
+int Watcher::run(const fs::path& dir, const OnChange& on_change, const fs::path& output) {
+    struct sigaction sa{};
+    sa.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    root = dir;
+    own_gitignore.reset();
+    if (opts.gitignore && output.filename() == ".gitignore") {
+        std::error_code ec;
+        auto base = fs::weakly_canonical(root, ec);
+        auto parent = fs::weakly_canonical(fs::absolute(output, ec).parent_path(), ec);
+        auto rel = parent.lexically_relative(base);
+        if (!ec && !rel.empty() && *rel.begin() != "..")
+            own_gitignore = rel == "." ? std::string() : rel.string();
+    }
+    rescan();
+    auto current = detected();
+    on_change(current);
+
+    while (!stop_requested) {
+        if (polling) {
+            poll(nullptr, 0, poll_interval_ms);
+            if (stop_requested) break;
+            rescan();
+        } else {
+            pollfd pfd{inotify_fd, POLLIN, 0};
+            int n = poll(&pfd, 1, -1);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) break;
+            // Take in the whole burst (a checkout, a build) before comparing.
+            do {
+                if (!handle_events()) {
+                    std::cerr << color::red << "Error: " << root.native() << " was removed or moved\n"
+                              << color::reset;
+                    return 1;
+                }
+            } while (!polling && poll(&pfd, 1, settle_ms) > 0);
+        }
+        auto now = detected();
+        if (now != current) {
+            current = std::move(now);
+            on_change(current);
+        }
+    }
+    return 0;
+}
+
+void Watcher::rescan() {
+    if (inotify_fd >= 0) close(inotify_fd);
+    inotify_fd = -1;
+    if (!polling) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd < 0) {
+            std::cerr << color::yellow << "Warning: inotify unavailable (" << std::strerror(errno)
+                      << "), rescanning every " << poll_interval_ms / 1000 << "s\n" << color::reset;
+            polling = true;
+        }
+    }
+    counts.assign(templates.size(), 0);
+    nodes.clear();
+    dirs.clear();
+    gitignores.clear();
+    scan("");
+    if (polling && inotify_fd >= 0) {
+        // The limit ran out part way: drop the watches there are.
+        close(inotify_fd);
+        inotify_fd = -1;
+        dirs.clear();
+    }
+}
+
+// Walks the directory `dir` (relative to the root), adding everything in
+// it and watching every directory opened.
+void Watcher::scan(const std::string& dir) {
+    int depth = components(dir);
+    if (max_depth >= 0 && depth > max_depth) return;
+
+    WalkOptions wopts;
+    wopts.threads = opts.threads;
+    wopts.max_depth = max_depth < 0 ? -1 : max_depth - depth;
+    wopts.prune = prune;
+    wopts.on_open = [&](std::string_view rel) {
+        std::lock_guard lock(m);
+        watch(join(dir, rel));
+    };
+    Walker walker(std::move(wopts));
+
+    std::vector<std::vector<std::pair<std::string, bool>>> found(walker.thread_count());
+    walker.walk(root / dir, [&](unsigned worker, const Walker::Entry& e) {
+        auto path = join(join(dir, e.dir), e.name);
+        bool descend = true;
+        if (e.is_dir && opts.gitignore) {
+            std::lock_guard lock(m);
+            descend = !ignored(path);
+        }
+        found[worker].emplace_back(std::move(path), e.is_dir);
+        return descend;
+    });
+
+    std::vector<std::string> candidates;
+    std::vector<std::uint32_t> rules;
+    for (auto& list : found)
+        for (auto& [path, is_dir] : list) {
+            add(path, is_dir);
+            if (is_dir || !matcher.has_content_rules() || candidates.size() >= Detector::max_content_candidates)
+                continue;
+            rules.clear();
+            matcher.match_content(base_name(path), rules);
+            if (!rules.empty()) candidates.push_back(std::move(path));
+        }
+    read_content(candidates);
+}
+
+void Watcher::watch(const std::string& dir) {
+    if (polling || inotify_fd < 0) return;
+    int wd = inotify_add_watch(inotify_fd, (root / dir).c_str(), watch_mask | IN_ONLYDIR | IN_DONT_FOLLOW);
+    if (wd >= 0) {
+        dirs[wd] = dir;
+    } else if (errno == ENOSPC || errno == ENOMEM) {
+        std::cerr << color::yellow << "Warning: inotify watch limit reached (fs.inotify.max_user_watches), "
+                  << "rescanning every " << poll_interval_ms / 1000 << "s\n" << color::reset;
+        polling = true;
+    }
+}
+
+void Watcher::add(const std::string& path, bool is_dir) {
+    auto [it, inserted] = nodes.try_emplace(path);
+    if (!inserted) return;
+    it->second.is_dir = is_dir;
+    for (auto t : name_matches(base_name(path))) counts[t]++;
+}
+
+// Each template whose @detect patterns match `name`, once.
+std::vector<std::uint32_t> Watcher::name_matches(std::string_view name) const {
+    std::vector<std::uint32_t> hits;
+    matcher.match(name, [&](std::uint32_t t) {
+        if (std::find(hits.begin(), hits.end(), t) == hits.end()) hits.push_back(t);
+    });
+    return hits;
+}
+
+void Watcher::remove(const std::string& path) {
+    auto node = nodes.find(path);
+    if (node == nodes.end()) return;
+    auto drop = [&](std::map<std::string, Node>::iterator first, std::map<std::string, Node>::iterator last) {
+        for (auto it = first; it != last; ++it) {
+            for (auto t : name_matches(base_name(it->first))) counts[t]--;
+            for (auto t : it->second.content) counts[t]--;
+        }
+        nodes.erase(first, last);
+    };
+    if (node->second.is_dir) {
+        for (auto it = dirs.begin(); it != dirs.end();) {
+            const auto& d = it->second;
+            if (d == path || (d.size() > path.size() && d.starts_with(path) && d[path.size()] == '/')) {
+                inotify_rm_watch(inotify_fd, it->first);
+                it = dirs.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        // Everything below "a/b" sorts from "a/b/" up to "a/b0".
+        drop(nodes.lower_bound(path + '/'), nodes.lower_bound(path + char('/' + 1)));
+    }
+    drop(node, std::next(node));
+}
+
+void Watcher::read_content(const std::vector<std::string>& paths) {
+    if (paths.empty()) return;
+    int dir_fd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) return;
+    PrefixReader reader(Detector::content_prefix, opts.threads);
+    reader.read(dir_fd, paths, [&](std::size_t i, std::string_view prefix) { update_content(paths[i], prefix); });
+    close(dir_fd);
+}
+
+// Replaces the @content matches of `path` with those of its new prefix.
+void Watcher::update_content(const std::string& path, std::string_view prefix) {
+    auto it = nodes.find(path);
+    if (it == nodes.end()) return;
+    auto& content = it->second.content;
+    for (auto t : content) counts[t]--;
+    content.clear();
+    std::vector<std::uint32_t> rules;
+    matcher.match_content(base_name(path), rules);
+    for (auto r : rules) {
+        const auto& rule = matcher.content_rule(r);
+        if (rule.matches(prefix) && std::find(content.begin(), content.end(), rule.tmpl) == content.end())
+            content.push_back(rule.tmpl);
+    }
+    for (auto t : content) counts[t]++;
+}
+
+// Whether a new directory would be walked into by a full scan.
+bool Watcher::descend(const std::string& path) const {
+    if (max_depth >= 0 && components(path) > max_depth) return false;
+    return !std::binary_search(prune.begin(), prune.end(), base_name(path), std::less<>());
+}
+
+// Whether the innermost .gitignore with a rule for the directory `dir`
+// excludes it, as Walker decides.
+bool Watcher::ignored(const std::string& dir) {
+    for (auto slash = dir.size(); slash != std::string::npos;) {
+        slash = slash == 0 ? std::string::npos : dir.rfind('/', slash - 1);
+        std::string base = slash == std::string::npos ? "" : dir.substr(0, slash);
+
+        auto [it, inserted] = gitignores.try_emplace(base);
+        if (inserted) {
+            int fd = open((root / base / ".gitignore").c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd >= 0) {
+                std::string content;
+                char buf[16384];
+                for (ssize_t n; (n = ::read(fd, buf, sizeof buf)) > 0;) content.append(buf, n);
+                close(fd);
+                it->second = std::make_unique<IgnoreMatcher>();
+                it->second->add(Generator::hand_written(content), join(base, ".gitignore"));
+            }
+        }
+        if (!it->second) continue;
+        int r = it->second->match(base.empty() ? std::string_view(dir) : std::string_view(dir).substr(base.size() + 1), true);
+        if (r >= 0) return it->second->ignores(r);
+    }
+    return false;
+}
+
+// Applies the pending events. False if the root itself went away.
+bool Watcher::handle_events() {
+    alignas(inotify_event) char buf[16384];
+    bool stale = false;
+    for (ssize_t len; (len = ::read(inotify_fd, buf, sizeof buf)) > 0;) {
+        for (char* p = buf; p < buf + len;) {
+            auto* ev = reinterpret_cast<inotify_event*>(p);
+            p += sizeof(inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                stale = true;
+                continue;
+            }
+            auto it = dirs.find(ev->wd);
+            if (it == dirs.end()) continue;
+            if (ev->mask & IN_IGNORED) {
+                bool was_root = it->second.empty();
+                dirs.erase(it);
+                if (was_root) return false;
+                continue;
+            }
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                if (it->second.empty()) return false;
+                continue;
+            }
+            if (!ev->len) continue;
+
+            std::string_view name(ev->name);
+            if (name == ".gitignore" && opts.gitignore && it->second != own_gitignore) stale = true;
+            if (name.empty() || name[0] == '.') continue;
+            auto path = join(it->second, name);
+            bool is_dir = ev->mask & IN_ISDIR;
+
+            if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) remove(path);
+            if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                add(path, is_dir);
+                if (is_dir) {
+                    if (descend(path) && !(opts.gitignore && ignored(path))) scan(path);
+                } else if (ev->mask & IN_MOVED_TO) {
+                    read_content({path});
+                }
+            }
+            // New files are empty when created; their content counts once
+            // they are written.
+            if ((ev->mask & IN_CLOSE_WRITE) && matcher.has_content_rules()) {
+                std::vector<std::uint32_t> rules;
+                matcher.match_content(name, rules);
+                if (!rules.empty()) read_content({path});
+            }
+            if (polling) {
+                // The watch limit ran out in scan(): start over without watches.
+                rescan();
+                return true;
+            }
+        }
+    }
+    if (stale) rescan();
+    return true;
+}
+
+std::vector<std::string> Watcher::detected() const {
+    std::vector<std::string> names;
+    for (std::size_t i = 0; i < templates.size(); i++)
+        if (counts[i] > 0) names.emplace_back(templates[i].name);
+    return names;
+}
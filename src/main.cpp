@@ -1,11 +1,30 @@
 #include "Common.hpp"
+#include "Coverage.hpp"
 #include "Detector.hpp"
+#include "Generator.hpp"
+#include "IgnoreMatcher.hpp"
 #include "Interactive.hpp"
+#include "Server.hpp"
+#include "Stats.hpp"
+#include "TemplateMixer.hpp"
+#include "TemplatePack.hpp"
 #include "TemplateStore.hpp"
+#include "Watcher.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 #include <getopt.h>
@@ -19,15 +38,56 @@ static void print_header() {
 static void print_usage() {
     std::cout
         << color::bold << "Usage:" << color::reset << "\n"
-        << "  autoignore [OPTIONS] [TEMPLATES...]\n\n"
+        << "  autoignore [OPTIONS] [TEMPLATES...]\n"
+        << "  autoignore <COMMAND> [ARGS...]\n\n"
+        << color::bold << "Commands:" << color::reset << "\n"
+        << "  info                    List templates with size, source and description\n"
+        << "  stats                   Show catalogue statistics\n"
+        << "  mix <templates...>      Analyse a combination: shared patterns and sizes\n"
+        << "  suggest [hint]          Suggest templates matching a project name\n"
+        << "  check-ignore [TEMPLATES...]\n"
+        << "                          Print the paths read from stdin that .gitignore (or\n"
+        << "                          the templates) would ignore; -z for NUL-separated\n"
+        << "                          input and output, -v to show the matching pattern,\n"
+        << "                          -n with -v to list unmatched paths, --from <file>\n"
+        << "  coverage [TEMPLATES...] Walk the tree once and report what each pattern of\n"
+        << "                          the detected templates matches, dead patterns and\n"
+        << "                          the largest untracked files left unignored\n"
+        << "                          (-j <n>, --top <n>, --from <file>, -v)\n"
+        << "  complete [-z] [prefix]  Print template names starting with prefix, plain,\n"
+        << "                          for shell completions (-z: NUL-separated)\n"
+        << "  pack -o <file> <dirs..> Build a template pack from directories of templates,\n"
+        << "                          .gitignore files and other packs, for\n"
+        << "                          AUTOIGNORE_PATH (-z: compress the bodies, -v)\n"
+        << "  serve [--socket <path>] Keep templates loaded and run other invocations'\n"
+        << "                          list, search, detect and generate requests\n\n"
         << color::bold << "Options:" << color::reset << "\n"
         << "  -l, --list              List available templates\n"
         << "  -s, --search <query>    Search templates by name\n"
         << "  -i, --interactive       Select templates interactively\n"
         << "  -d, --detect            Auto-detect templates from project files\n"
         << "  -o, --output <file>     Output file (default: .gitignore)\n"
-        << "  -a, --append            Append to existing file\n"
+        << "  -a, --append            Add only what the existing file lacks\n"
         << "  -p, --preview           Preview output without writing\n"
+        << "  -m, --merge             Write each pattern once, under the first template\n"
+        << "                          that has it\n"
+        << "  -j, --jobs <n>          Threads used by --detect (default: one per core)\n"
+        << "      --max-entries <n>   Stop --detect after visiting n entries\n"
+        << "      --time-budget <ms>  Stop --detect after ms milliseconds\n"
+        << "      --prune <dir,...>   Do not descend into these directories in --detect\n"
+        << "      --no-prune          Descend everywhere in --detect: ignore .gitignore\n"
+        << "                          files and the default list (node_modules, target...)\n"
+        << "      --check             Exit 1 if the templates of the output file changed\n"
+        << "                          since it was generated\n"
+        << "      --update            Re-render the sections of the output file whose\n"
+        << "                          template changed; no-op if none did\n"
+        << "      --watch             With --detect, keep watching the tree and rewrite\n"
+        << "                          the output whenever the detected set changes\n"
+        << "      --batch <file>      Detect and generate for each root listed in file\n"
+        << "                          (- for stdin), printing one JSON line per root\n"
+        << "      --stats-json <file> Write time per phase and counters as JSON (- for\n"
+        << "                          stderr)\n"
+        << "      --trace <file>      Write the phases as a Chrome trace-event file\n"
         << "  -v, --verbose           Verbose output\n"
         << "  -h, --help              Show this help\n\n"
         << color::bold << "Examples:" << color::reset << "\n"
@@ -52,17 +112,7 @@ static void cmd_list(TemplateStore& store) {
         std::cout << "\n";
     }
     std::cout << "\n" << color::gray << "Template locations:\n" << color::reset;
-    for (const auto& p : store.paths()) {
-        std::cout << "  " << color::cyan << p.string() << color::reset;
-        namespace fs = std::filesystem;
-        if (fs::exists(p) && fs::is_directory(p)) {
-            auto n = std::distance(fs::directory_iterator(p), fs::directory_iterator{});
-            std::cout << color::gray << "  (" << n << " files)" << color::reset;
-        } else {
-            std::cout << color::gray << "  (not found)" << color::reset;
-        }
-        std::cout << "\n";
-    }
+    TemplateMixer(store).show_locations();
 }
 
 static void cmd_search(TemplateStore& store, const std::string& query) {
@@ -79,64 +129,595 @@ static void cmd_search(TemplateStore& store, const std::string& query) {
 static void generate(TemplateStore& store,
                      const std::vector<std::string>& names,
                      const std::string& output,
-                     bool append, bool preview, bool verbose)
+                     bool append, bool merge, bool preview, bool verbose)
 {
-    std::vector<std::pair<std::string, std::string>> contents;
-    for (const auto& name : names) {
-        const auto* t = store.find(name);
-        if (!t) {
-            std::cerr << color::yellow << "Warning: template '" << name << "' not found\n" << color::reset;
-            continue;
-        }
-        contents.emplace_back(name, store.read_content(*t));
+    GenerateOptions opts;
+    opts.output = output;
+    opts.append = append;
+    opts.merge = merge;
+    opts.preview = preview;
+
+    Generator gen(store);
+    std::cout.flush();
+    auto result = gen.generate(names, opts);
+
+    for (const auto& name : result.missing)
+        std::cerr << color::yellow << "Warning: template '" << name << "' not found\n" << color::reset;
+
+    if (!result.error.empty()) {
+        std::cerr << color::red << "Error: " << result.error << "\n" << color::reset;
+        return;
+    }
+    if (preview) return;
+
+    if (verbose) {
+        for (const auto& name : result.templates)
+            std::cout << color::green << "  + " << name << color::reset << "\n";
+        for (const auto& name : result.present)
+            std::cout << color::yellow << "  = " << name << color::reset << " (already in " << output << ")\n";
+        for (const auto& d : result.dropped)
+            std::cout << color::yellow << "  - " << d.pattern << color::reset << " (" << d.template_name
+                      << ", already in " << d.first << ")\n";
     }
 
-    if (contents.empty()) {
-        std::cerr << color::red << "Error: no valid templates\n" << color::reset;
+    if (result.templates.empty()) {
+        std::cout << color::bold << output << color::reset << " already has these templates\n";
         return;
     }
+    std::cout << color::green << (append ? "Appended to " : "Generated ")
+              << color::bold << output << color::reset << "\n";
+}
+
+// What --batch does for each root.
+enum class BatchMode { generate, check, update };
+
+static std::string json_list(const std::vector<std::string>& items) {
+    std::string j = "[";
+    for (std::size_t i = 0; i < items.size(); i++) j += (i ? "," : "") + json::quote(items[i]);
+    return j + "]";
+}
 
-    if (preview) {
-        for (const auto& [name, content] : contents) {
-            std::cout << color::bold << color::cyan << "# " << name << color::reset << "\n"
-                      << content;
-            if (!content.ends_with('\n')) std::cout << "\n";
+// Detects and generates (or checks or updates the output) for every root
+// listed in `list` ("-" for stdin), one JSON line per root in input order.
+static int cmd_batch(TemplateStore& store,
+                     const std::string& list,
+                     const std::vector<std::string>& extra,
+                     const std::string& output,
+                     bool append, bool merge, DetectOptions dopts,
+                     BatchMode mode = BatchMode::generate)
+{
+    std::vector<std::string> roots;
+    {
+        std::ifstream file;
+        if (list != "-") {
+            file.open(list);
+            if (!file) {
+                std::cerr << color::red << "Error: cannot open " << list << "\n" << color::reset;
+                return 1;
+            }
+        }
+        std::istream& in = list == "-" ? std::cin : file;
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (!line.empty()) roots.push_back(line);
+        }
+    }
+
+    // The catalogue is loaded and the matcher compiled once, before any
+    // worker touches the shared store. Roots run in parallel, each walk on
+    // one thread.
+    unsigned jobs = dopts.threads;
+    dopts.threads = 1;
+    Detector detector(store, dopts);
+    Generator gen(store);
+
+    std::vector<std::string> lines(roots.size());
+    std::vector<char> ready(roots.size(), 0);
+    std::size_t printed = 0;
+    std::mutex out_mutex;
+    std::atomic<std::size_t> next{0};
+    std::atomic<bool> failed{false};
+
+    // --check and --update read what the stamp says; no detection.
+    auto process_stamped = [&](const std::string& root) {
+        std::filesystem::path out = output;
+        if (out.is_relative()) out = std::filesystem::path(root) / out;
+        std::string j = "{\"root\":" + json::quote(root) + ",\"output\":" + json::quote(out.string());
+        std::string error;
+        if (mode == BatchMode::check) {
+            auto r = gen.check(out);
+            j += ",\"stale\":";
+            j += r.stale() ? "true" : "false";
+            j += ",\"changed\":" + json_list(r.changed) + ",\"missing\":" + json_list(r.missing);
+            error = r.error;
+            if (r.stale()) failed = true;
+        } else {
+            auto r = gen.update(out);
+            j += ",\"updated\":" + json_list(r.templates) + ",\"missing\":" + json_list(r.missing);
+            error = r.error;
+        }
+        j += ",\"error\":";
+        j += error.empty() ? "null" : json::quote(error);
+        j += "}\n";
+        return std::make_pair(std::move(j), !error.empty());
+    };
+
+    auto process = [&](const std::string& root) {
+        if (mode != BatchMode::generate) return process_stamped(root);
+        auto detected = detector.detect(root);
+        std::vector<std::string> names = extra;
+        std::unordered_set<std::string> seen(names.begin(), names.end());
+        for (const auto& t : detected.templates)
+            if (seen.insert(t).second) names.push_back(t);
+
+        std::filesystem::path out = output;
+        if (out.is_relative()) out = std::filesystem::path(root) / out;
+
+        GenerateResult result;
+        std::error_code ec;
+        if (!std::filesystem::is_directory(root, ec)) {
+            result.error = "not a directory";
+        } else if (names.empty()) {
+            result.error = "no templates detected";
+        } else {
+            GenerateOptions gopts;
+            gopts.output = out;
+            gopts.append = append;
+            gopts.merge = merge;
+            result = gen.generate(names, gopts);
+        }
+
+        std::string j = "{\"root\":" + json::quote(root) + ",\"detected\":" + json_list(detected.templates);
+        j += ",\"templates\":" + json_list(result.templates);
+        j += ",\"missing\":" + json_list(result.missing);
+        if (append) j += ",\"present\":" + json_list(result.present);
+        j += ",\"partial\":";
+        j += detected.partial ? "true" : "false";
+        j += ",\"output\":";
+        j += result.error.empty() ? json::quote(out.string()) : "null";
+        j += ",\"error\":";
+        j += result.error.empty() ? "null" : json::quote(result.error);
+        j += "}\n";
+        return std::make_pair(std::move(j), !result.error.empty());
+    };
+
+    auto worker = [&]() {
+        for (std::size_t i; (i = next.fetch_add(1)) < roots.size();) {
+            auto [line, error] = process(roots[i]);
+            std::lock_guard lock(out_mutex);
+            lines[i] = std::move(line);
+            ready[i] = 1;
+            if (error) failed = true;
+            while (printed < roots.size() && ready[printed]) {
+                std::cout << lines[printed];
+                lines[printed].clear();
+                lines[printed].shrink_to_fit();
+                printed++;
+            }
+            std::cout.flush();
+        }
+    };
+
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < jobs && i < roots.size(); i++) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+
+    return failed ? 1 : 0;
+}
+
+// Reads paths from stdin and prints those the patterns ignore, like
+// `git check-ignore --stdin`. Verdicts are written after every read, so the
+// output streams when the input does.
+static int cmd_check_ignore(const std::vector<std::string>& args) {
+    bool nul = false, verbose = false, non_matching = false;
+    std::string from;
+    std::vector<std::string> names;
+    for (std::size_t i = 0; i < args.size(); i++) {
+        const auto& a = args[i];
+        if (a == "-z") nul = true;
+        else if (a == "-v" || a == "--verbose") verbose = true;
+        else if (a == "-n" || a == "--non-matching") non_matching = true;
+        else if (a == "--from" && i + 1 < args.size()) from = args[++i];
+        else if (a.starts_with("-")) {
+            std::cerr << color::red << "Error: unknown check option " << a << "\n" << color::reset;
+            return 128;
+        } else names.push_back(a);
+    }
+    if (non_matching && !verbose) {
+        std::cerr << color::red << "Error: --non-matching is only valid with --verbose\n" << color::reset;
+        return 128;
+    }
+
+    IgnoreMatcher matcher;
+    if (!names.empty() && from.empty()) {
+        TemplateStore store;
+        for (const auto& name : names) {
+            const auto* t = store.find(name);
+            if (!t) {
+                std::cerr << color::red << "Error: template '" << name << "' not found\n" << color::reset;
+                return 128;
+            }
+            matcher.add(store.open_content(*t).view(), name);
+        }
+    } else {
+        if (from.empty()) from = ".gitignore";
+        std::ifstream f(from, std::ios::binary);
+        if (!f) {
+            std::cerr << color::red << "Error: cannot open " << from << "\n" << color::reset;
+            return 128;
+        }
+        std::string content((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        matcher.add(content, from);
+    }
+
+    const char sep = nul ? '\0' : '\n';
+    const char field = nul ? '\0' : ':';
+    std::string out;
+    out.reserve(1 << 16);
+    auto flush = [&] {
+        std::size_t done = 0;
+        while (done < out.size()) {
+            auto n = write(STDOUT_FILENO, out.data() + done, out.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += n;
+        }
+        out.clear();
+        return true;
+    };
+
+    bool any = false;
+    auto verdict = [&](std::string_view record) {
+        auto path = record;
+        while (path.starts_with("./")) path.remove_prefix(2);
+        while (path.starts_with('/')) path.remove_prefix(1);
+        bool is_dir = path.ends_with('/');
+        while (path.ends_with('/')) path.remove_suffix(1);
+        if (path.empty()) return;
+
+        int r = matcher.check(path, is_dir);
+        if (matcher.ignores(r)) any = true;
+        if (verbose && (r >= 0 || non_matching)) {
+            if (r >= 0) {
+                const auto& rule = matcher.rule(r);
+                out += matcher.source(rule);
+                out += field;
+                out += std::to_string(rule.line);
+                out += field;
+                out += rule.text;
+            } else {
+                out += field;
+                out += field;
+            }
+            out += nul ? '\0' : '\t';
+        } else if (!matcher.ignores(r)) {
+            return;
+        }
+        out += record;
+        out += sep;
+    };
+
+    std::string buf(1 << 16, '\0');
+    std::size_t have = 0;
+    for (;;) {
+        if (have == buf.size()) buf.resize(buf.size() * 2);  // a very long path
+        auto n = read(STDIN_FILENO, buf.data() + have, buf.size() - have);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        have += n;
+        std::size_t start = 0;
+        for (std::size_t end; (end = std::string_view(buf.data(), have).find(sep, start)) != std::string_view::npos;
+             start = end + 1)
+            verdict(std::string_view(buf.data() + start, end - start));
+        std::memmove(buf.data(), buf.data() + start, have - start);
+        have -= start;
+        if (!flush()) return 128;
+    }
+    if (have) verdict(std::string_view(buf.data(), have));
+    if (!flush()) return 128;
+    return any ? 0 : 1;
+}
+
+static std::string human_bytes(std::uint64_t n) {
+    static const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+    double v = (double)n;
+    int u = 0;
+    while (v >= 1024 && u < 4) { v /= 1024; u++; }
+    char buf[32];
+    std::snprintf(buf, sizeof buf, u ? "%.1f %s" : "%.0f %s", v, units[u]);
+    return buf;
+}
+
+// Walks the current directory once and reports which patterns of the
+// detected (or given) templates decide which files, which never decide
+// anything, and the largest untracked files and directories left unignored.
+static int cmd_coverage(const std::vector<std::string>& args) {
+    CoverageOptions copts;
+    bool verbose = false;
+    std::string from;
+    std::vector<std::string> names;
+    for (std::size_t i = 0; i < args.size(); i++) {
+        const auto& a = args[i];
+        bool has_value = i + 1 < args.size();
+        if (a == "-v" || a == "--verbose") verbose = true;
+        else if ((a == "-j" || a == "--jobs") && has_value) copts.threads = (unsigned)std::strtoul(args[++i].c_str(), nullptr, 10);
+        else if (a == "--top" && has_value) copts.top = std::strtoull(args[++i].c_str(), nullptr, 10);
+        else if (a == "--from" && has_value) from = args[++i];
+        else if (a.starts_with("-")) {
+            std::cerr << color::red << "Error: unknown coverage option " << a << "\n" << color::reset;
+            return 1;
+        } else names.push_back(a);
+    }
+
+    IgnoreMatcher matcher;
+    if (!from.empty()) {
+        std::ifstream f(from, std::ios::binary);
+        if (!f) {
+            std::cerr << color::red << "Error: cannot open " << from << "\n" << color::reset;
+            return 1;
+        }
+        std::string content((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        matcher.add(content, from);
+    } else {
+        TemplateStore store;
+        if (names.empty()) {
+            DetectOptions dopts;
+            dopts.threads = copts.threads;
+            names = Detector(store, dopts).detect(".").templates;
+            if (names.empty()) {
+                std::cout << color::yellow << "No templates detected for this directory.\n" << color::reset;
+                return 1;
+            }
+        }
+        for (const auto& name : names) {
+            const auto* t = store.find(name);
+            if (!t) {
+                std::cerr << color::yellow << "Warning: template '" << name << "' not found\n" << color::reset;
+                continue;
+            }
+            matcher.add(store.open_content(*t).view(), name);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto report = Coverage(matcher, copts).run(".");
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << color::bold << "Coverage: " << color::reset << report.files << " files, "
+              << human_bytes(report.bytes) << "; ignored " << report.ignored_files << " files, "
+              << human_bytes(report.ignored_bytes) << color::gray << " (" << ms << " ms)" << color::reset << "\n";
+
+    // Rules are grouped by source, in order.
+    for (std::size_t i = 0; i < matcher.size();) {
+        const auto& src = matcher.source(matcher.rule(i));
+        std::vector<std::string_view> dead;
+        std::cout << "\n" << color::bold << color::cyan << src << color::reset << "\n";
+        for (; i < matcher.size() && &matcher.source(matcher.rule(i)) == &src; i++) {
+            const auto& rule = matcher.rule(i);
+            const auto& p = report.patterns[i];
+            if (p.files == 0 && p.dirs == 0) {
+                dead.push_back(rule.text);
+                continue;
+            }
+            char line[64];
+            std::snprintf(line, sizeof line, "  %8llu files %10s  ", (unsigned long long)p.files, human_bytes(p.bytes).c_str());
+            std::cout << line << color::green << rule.text << color::reset;
+            if (p.dirs) std::cout << color::gray << "  (" << p.dirs << (p.dirs == 1 ? " dir)" : " dirs)") << color::reset;
             std::cout << "\n";
         }
-        return;
+        if (dead.empty()) continue;
+        std::cout << color::yellow << "  matched nothing (" << dead.size() << ")" << color::reset;
+        if (verbose) {
+            std::cout << ":";
+            for (auto d : dead) std::cout << " " << d;
+        }
+        std::cout << "\n";
     }
 
-    std::ofstream f(output, append ? std::ios::app : std::ios::trunc);
-    if (!f) {
-        std::cerr << color::red << "Error: cannot open " << output << "\n" << color::reset;
-        return;
+    auto print_items = [](const char* title, const std::vector<CoverageReport::Item>& items) {
+        if (items.empty()) return;
+        std::cout << "\n" << color::bold << title << color::reset << "\n";
+        for (const auto& item : items) {
+            char line[32];
+            std::snprintf(line, sizeof line, "  %10s  ", human_bytes(item.bytes).c_str());
+            std::cout << line << color::yellow << item.path << color::reset;
+            if (item.files > 1) std::cout << color::gray << "  (" << item.files << " files)" << color::reset;
+            std::cout << "\n";
+        }
+    };
+    print_items("Largest untracked files not ignored:", report.largest_files);
+    print_items("Largest untracked directories not ignored:", report.largest_dirs);
+    if (!report.tracked_known)
+        std::cout << "\n" << color::gray << "(not a git work tree: every file counts as untracked)" << color::reset << "\n";
+    return 0;
+}
+
+// Template names starting with a prefix, plain, one per line (NUL-ended
+// with -z), for the shell completions.
+static int cmd_complete(const std::vector<std::string>& args) {
+    bool nul = false;
+    std::string_view prefix;
+    for (std::size_t i = 0; i < args.size(); i++) {
+        if (args[i] == "-z") nul = true;
+        else if (args[i] == "--" && i + 1 < args.size()) prefix = args[++i];
+        else if (!args[i].starts_with('-')) prefix = args[i];
+    }
+    std::string out;
+    for (const auto& name : TemplateStore().names(prefix)) {
+        out += name;
+        out += nul ? '\0' : '\n';
+    }
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    return 0;
+}
+
+// Builds a template pack. A name given by an earlier input wins, as in
+// the search path.
+static int cmd_pack(const std::vector<std::string>& args) {
+    std::string output;
+    bool compress = false;
+    bool verbose = false;
+    std::vector<fs::path> inputs;
+    for (std::size_t i = 0; i < args.size(); i++) {
+        const auto& a = args[i];
+        if ((a == "-o" || a == "--output") && i + 1 < args.size()) output = args[++i];
+        else if (a == "-z" || a == "--compress") compress = true;
+        else if (a == "-v" || a == "--verbose") verbose = true;
+        else if (a.starts_with("-")) {
+            std::cerr << color::red << "Error: unknown pack option " << a << "\n" << color::reset;
+            return 1;
+        } else inputs.push_back(a);
+    }
+    if (output.empty() || inputs.empty()) {
+        std::cerr << color::red << "Error: pack needs -o <file> and at least one input\n" << color::reset;
+        return 1;
+    }
+    if (compress && !TemplatePack::compression_supported()) {
+        std::cerr << color::red << "Error: built without zlib, cannot compress\n" << color::reset;
+        return 1;
     }
 
-    f << "# Generated by autoignore\n# Templates:";
-    for (const auto& [name, _] : contents) f << " " << name;
-    f << "\n\n";
+    std::vector<TemplatePack::Source> sources;
+    std::unordered_set<std::string> seen;
+    auto add = [&](std::string name, std::string body) {
+        if (!seen.insert(name).second) return;
+        TemplatePack::Source s;
+        s.name = std::move(name);
+        s.body = std::move(body);
+        TemplateStore::parse_header(s.body, s.detect_patterns, s.content_rules);
+        s.hash = TemplateStore::content_hash(s.body);
+        sources.push_back(std::move(s));
+    };
+    auto add_file = [&](const fs::path& file) {
+        std::ifstream in(file, std::ios::binary);
+        if (!in) return false;
+        auto name = file.filename().string();
+        name.resize(name.size() - std::string_view(".gitignore").size());
+        add(std::move(name), std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>()));
+        return true;
+    };
+    for (const auto& input : inputs) {
+        std::error_code ec;
+        if (fs::is_directory(input, ec)) {
+            std::vector<fs::path> files;
+            for (const auto& entry : fs::directory_iterator(input, ec))
+                if (entry.path().filename().string().ends_with(".gitignore") && entry.is_regular_file(ec))
+                    files.push_back(entry.path());
+            std::sort(files.begin(), files.end());
+            for (const auto& file : files) {
+                if (!add_file(file)) {
+                    std::cerr << color::red << "Error: cannot read " << file.string() << "\n" << color::reset;
+                    return 1;
+                }
+            }
+        } else if (input.filename().string().ends_with(".gitignore")) {
+            if (!add_file(input)) {
+                std::cerr << color::red << "Error: cannot read " << input.string() << "\n" << color::reset;
+                return 1;
+            }
+        } else if (auto pack = TemplatePack::open(input)) {
+            for (std::size_t i = 0; i < pack->size(); i++) {
+                std::unique_ptr<char[]> buffer;
+                auto body = pack->body(i, buffer);
+                if (body.size() != pack->body_size(i)) {
+                    std::cerr << color::red << "Error: cannot inflate " << pack->name(i) << " in "
+                              << input.string() << "\n" << color::reset;
+                    return 1;
+                }
+                add(std::string(pack->name(i)), std::string(body));
+            }
+        } else {
+            std::cerr << color::red << "Error: " << input.string()
+                      << " is not a directory, a .gitignore file or a pack\n" << color::reset;
+            return 1;
+        }
+    }
 
-    for (const auto& [name, content] : contents) {
-        if (verbose) std::cout << color::green << "  + " << name << color::reset << "\n";
-        f << "# " << name << "\n" << content;
-        if (!content.ends_with('\n')) f << "\n";
-        f << "\n";
+    if (verbose)
+        for (const auto& s : sources) std::cout << color::green << "  + " << s.name << color::reset << "\n";
+    auto count = sources.size();
+    if (!TemplatePack::write(output, std::move(sources), compress)) {
+        std::cerr << color::red << "Error: cannot write " << output << "\n" << color::reset;
+        return 1;
     }
+    std::error_code ec;
+    std::cout << color::green << "Packed " << count << " templates into " << color::bold << output << color::reset
+              << color::gray << " (" << human_bytes(fs::file_size(output, ec)) << ")" << color::reset << "\n";
+    return 0;
+}
 
-    std::cout << color::green << (append ? "Appended to " : "Generated ")
-              << color::bold << output << color::reset << "\n";
+static int cmd_serve(const std::vector<std::string>& args);
+
+// Runs a subcommand; `args` are the words after it. Returns -1 if `cmd` is
+// not a subcommand, so that it is treated as a template name.
+static int run_command(std::string_view cmd, std::vector<std::string> args) {
+    if (cmd == "check-ignore") return cmd_check_ignore(args);
+    if (cmd == "coverage") return cmd_coverage(args);
+    if (cmd == "complete") return cmd_complete(args);
+    if (cmd == "pack") return cmd_pack(args);
+    if (cmd == "serve") return cmd_serve(args);
+    if (cmd != "info" && cmd != "stats" && cmd != "mix" && cmd != "suggest") return -1;
+
+    bool verbose = false;
+    std::erase_if(args, [&](const std::string& a) {
+        if (a != "-v" && a != "--verbose") return false;
+        verbose = true;
+        return true;
+    });
+
+    TemplateStore store;
+    TemplateMixer mixer(store);
+    mixer.set_verbose(verbose);
+    if (cmd == "info") {
+        mixer.list_templates_detailed();
+    } else if (cmd == "stats") {
+        mixer.show_template_statistics();
+    } else if (cmd == "mix") {
+        if (args.empty()) {
+            std::cerr << color::red << "Error: mix needs at least one template\n" << color::reset;
+            return 1;
+        }
+        mixer.preview_mix(mixer.optimize_template_selection(args));
+    } else if (cmd == "suggest") {
+        auto names = mixer.suggest_templates(args.empty() ? "" : args[0]);
+        if (names.empty()) {
+            std::cout << color::yellow << "No suggestions.\n" << color::reset;
+            return 0;
+        }
+        for (const auto& n : names) std::cout << color::green << n << color::reset << "\n";
+    }
+    return 0;
 }
 
-int main(int argc, char* argv[]) {
-    bool do_list        = false;
-    bool do_interactive = false;
-    bool do_detect      = false;
-    bool do_preview     = false;
-    bool append         = false;
-    bool verbose        = false;
+enum LongOpt { OPT_MAX_ENTRIES = 256, OPT_TIME_BUDGET, OPT_BATCH, OPT_PRUNE, OPT_NO_PRUNE, OPT_STATS_JSON, OPT_TRACE, OPT_WATCH, OPT_CHECK, OPT_UPDATE };
+
+// A command line other than a subcommand.
+struct CliOptions {
+    bool list        = false;
+    bool interactive = false;
+    bool detect      = false;
+    bool preview     = false;
+    bool append      = false;
+    bool merge       = false;
+    bool verbose     = false;
+    bool watch       = false;
+    bool check       = false;
+    bool update      = false;
     std::string search_query;
     std::string output = ".gitignore";
+    DetectOptions detect_opts;
+    std::string batch_list;
+    std::string stats_json;
+    std::string trace;
+    std::vector<std::string> templates;
+};
 
+// Returns -1 once `o` is filled in, or the exit status for --help and bad
+// options. Safe to call more than once per process (the daemon does).
+static int parse_options(int argc, char* argv[], CliOptions& o) {
     static const struct option long_opts[] = {
         {"list",        no_argument,       nullptr, 'l'},
         {"search",      required_argument, nullptr, 's'},
@@ -145,47 +726,162 @@ int main(int argc, char* argv[]) {
         {"output",      required_argument, nullptr, 'o'},
         {"append",      no_argument,       nullptr, 'a'},
         {"preview",     no_argument,       nullptr, 'p'},
+        {"merge",       no_argument,       nullptr, 'm'},
+        {"jobs",        required_argument, nullptr, 'j'},
+        {"max-entries", required_argument, nullptr, OPT_MAX_ENTRIES},
+        {"time-budget", required_argument, nullptr, OPT_TIME_BUDGET},
+        {"batch",       required_argument, nullptr, OPT_BATCH},
+        {"prune",       required_argument, nullptr, OPT_PRUNE},
+        {"no-prune",    no_argument,       nullptr, OPT_NO_PRUNE},
+        {"watch",       no_argument,       nullptr, OPT_WATCH},
+        {"check",       no_argument,       nullptr, OPT_CHECK},
+        {"update",      no_argument,       nullptr, OPT_UPDATE},
+        {"stats-json",  required_argument, nullptr, OPT_STATS_JSON},
+        {"trace",       required_argument, nullptr, OPT_TRACE},
         {"verbose",     no_argument,       nullptr, 'v'},
         {"help",        no_argument,       nullptr, 'h'},
         {nullptr, 0, nullptr, 0}
     };
 
     int c, idx = 0;
-    while ((c = getopt_long(argc, argv, "ls:ido:apvh", long_opts, &idx)) != -1) {
+    optind = 0;  // full rescan, getopt state included
+    while ((c = getopt_long(argc, argv, "ls:ido:apmj:vh", long_opts, &idx)) != -1) {
         switch (c) {
-            case 'l': do_list = true;           break;
-            case 's': search_query = optarg;    break;
-            case 'i': do_interactive = true;    break;
-            case 'd': do_detect = true;         break;
-            case 'o': output = optarg;          break;
-            case 'a': append = true;            break;
-            case 'p': do_preview = true;        break;
-            case 'v': verbose = true;           break;
+            case 'l': o.list = true;            break;
+            case 's': o.search_query = optarg;  break;
+            case 'i': o.interactive = true;     break;
+            case 'd': o.detect = true;          break;
+            case 'o': o.output = optarg;        break;
+            case 'a': o.append = true;          break;
+            case 'p': o.preview = true;         break;
+            case 'm': o.merge = true;           break;
+            case 'j': o.detect_opts.threads = (unsigned)std::strtoul(optarg, nullptr, 10); break;
+            case OPT_MAX_ENTRIES: o.detect_opts.max_entries = std::strtoull(optarg, nullptr, 10); break;
+            case OPT_BATCH: o.batch_list = optarg; break;
+            case OPT_WATCH: o.watch = true; break;
+            case OPT_CHECK: o.check = true; break;
+            case OPT_UPDATE: o.update = true; break;
+            case OPT_STATS_JSON: o.stats_json = optarg; break;
+            case OPT_TRACE: o.trace = optarg; break;
+            case OPT_PRUNE:
+                for (std::string_view list = optarg; !list.empty();) {
+                    auto comma = list.find(',');
+                    auto name = list.substr(0, comma);
+                    if (!name.empty()) o.detect_opts.prune.emplace_back(name);
+                    list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+                }
+                break;
+            case OPT_NO_PRUNE:
+                o.detect_opts.prune_defaults = false;
+                o.detect_opts.gitignore = false;
+                break;
+            case OPT_TIME_BUDGET:
+                o.detect_opts.time_budget = std::chrono::milliseconds(std::strtoll(optarg, nullptr, 10));
+                break;
+            case 'v': o.verbose = true;         break;
             case 'h': print_header(); print_usage(); return 0;
             case '?': return 1;
         }
     }
+    for (int i = optind; i < argc; i++) o.templates.push_back(argv[i]);
+    return -1;
+}
 
-    TemplateStore store;
+// --check: exit status 1 if the output was made from templates that have
+// changed since, or is not a generated file.
+static int cmd_check_stamp(TemplateStore& store, const std::string& output) {
+    auto result = Generator(store).check(output);
+    if (!result.error.empty()) {
+        std::cerr << color::red << "Error: " << result.error << "\n" << color::reset;
+        return 1;
+    }
+    if (!result.stale()) {
+        std::cout << color::green << output << " is up to date\n" << color::reset;
+        return 0;
+    }
+    std::cout << color::yellow << output << " is out of date:\n" << color::reset;
+    for (const auto& name : result.changed)
+        std::cout << "  " << color::yellow << "~ " << name << color::reset << color::gray << "  (changed)\n" << color::reset;
+    for (const auto& name : result.missing)
+        std::cout << "  " << color::red << "- " << name << color::reset << color::gray << "  (not found)\n" << color::reset;
+    return 1;
+}
 
-    if (do_list) {
+// --update: re-renders what --check reports as changed.
+static int cmd_update(TemplateStore& store, const std::string& output, bool verbose) {
+    auto result = Generator(store).update(output);
+    for (const auto& name : result.missing)
+        std::cerr << color::yellow << "Warning: template '" << name << "' not found\n" << color::reset;
+    if (!result.error.empty()) {
+        std::cerr << color::red << "Error: " << result.error << "\n" << color::reset;
+        return 1;
+    }
+    if (result.templates.empty()) {
+        std::cout << color::green << output << " is up to date\n" << color::reset;
+        return 0;
+    }
+    if (verbose)
+        for (const auto& name : result.templates)
+            std::cout << color::green << "  ~ " << name << color::reset << "\n";
+    std::cout << color::green << "Updated " << color::bold << output << color::reset << "\n";
+    return 0;
+}
+
+// --detect --watch: regenerates the output whenever the detected set
+// changes, until interrupted.
+static int cmd_watch(TemplateStore& store, const CliOptions& o) {
+    if (!o.detect || o.interactive || o.append || !o.batch_list.empty()) {
+        std::cerr << color::red << "Error: --watch needs --detect and does not combine with "
+                  << "--interactive, --append or --batch\n" << color::reset;
+        return 1;
+    }
+    Watcher watcher(store, o.detect_opts);
+    return watcher.run(".", [&](const std::vector<std::string>& detected) {
+        if (detected.empty()) {
+            std::cout << color::yellow << "No templates detected for this directory.\n" << color::reset;
+        } else {
+            std::cout << color::bold << "Detected: " << color::reset;
+            for (const auto& t : detected) std::cout << color::green << t << " " << color::reset;
+            std::cout << "\n";
+        }
+        std::vector<std::string> names = o.templates;
+        std::unordered_set<std::string> seen(names.begin(), names.end());
+        for (const auto& t : detected)
+            if (seen.insert(t).second) names.push_back(t);
+        if (!names.empty()) generate(store, names, o.output, false, o.merge, o.preview, o.verbose);
+        std::cout.flush();
+    }, o.preview ? fs::path() : fs::path(o.output));
+}
+
+// Runs a parsed command line in the current directory. `detector`, when
+// given, is a compiled matcher for `store` kept by the daemon.
+static int run_options(TemplateStore& store, const Detector* detector, CliOptions& o) {
+    if (o.list) {
         print_header();
         cmd_list(store);
         return 0;
     }
 
-    if (!search_query.empty()) {
+    if (!o.search_query.empty()) {
         print_header();
-        cmd_search(store, search_query);
+        cmd_search(store, o.search_query);
         return 0;
     }
 
-    std::vector<std::string> templates;
-    for (int i = optind; i < argc; i++) templates.push_back(argv[i]);
+    if (o.watch) return cmd_watch(store, o);
 
-    if (do_detect) {
-        Detector detector(store);
-        auto detected = detector.detect(".");
+    auto& templates = o.templates;
+    if (!o.batch_list.empty()) {
+        auto mode = o.check ? BatchMode::check : o.update ? BatchMode::update : BatchMode::generate;
+        return cmd_batch(store, o.batch_list, templates, o.output, o.append, o.merge, o.detect_opts, mode);
+    }
+    if (o.check) return cmd_check_stamp(store, o.output);
+    if (o.update) return cmd_update(store, o.output, o.verbose);
+
+    if (o.detect) {
+        auto result = detector ? detector->detect(".", o.detect_opts)
+                               : Detector(store, o.detect_opts).detect(".");
+        const auto& detected = result.templates;
         if (detected.empty()) {
             std::cout << color::yellow << "No templates detected for this directory.\n" << color::reset;
         } else {
@@ -196,16 +892,19 @@ int main(int argc, char* argv[]) {
             for (const auto& t : detected)
                 if (!seen.count(t)) { templates.push_back(t); seen.insert(t); }
         }
+        if (result.partial)
+            std::cout << color::yellow << "Detection is partial: budget ran out after "
+                      << result.entries << " entries.\n" << color::reset;
     }
 
-    if (do_interactive) {
+    if (o.interactive) {
         if (!isatty(STDIN_FILENO)) {
             std::cerr << color::red << "Error: interactive mode requires a terminal\n" << color::reset;
             return 1;
         }
         store.all();
         std::vector<std::string> names;
-        for (const auto& t : store.all()) names.push_back(t.name);
+        for (const auto& t : store.all()) names.emplace_back(t.name);
 
         std::unordered_set<std::string> presel(templates.begin(), templates.end());
         InteractiveSelector sel;
@@ -221,6 +920,86 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    generate(store, templates, output, append, do_preview, verbose);
+    generate(store, templates, o.output, o.append, o.merge, o.preview, o.verbose);
     return 0;
 }
+
+// Writes a --stats-json or --trace report to `path` ("-" for stderr); an
+// empty path writes nothing.
+static bool write_stats(const Stats& stats, const std::string& path, bool trace) {
+    if (path.empty()) return true;
+    if (path == "-") {
+        trace ? stats.write_trace(std::cerr) : stats.write_json(std::cerr);
+        return true;
+    }
+    std::ofstream out(path);
+    if (out) trace ? stats.write_trace(out) : stats.write_json(out);
+    if (!out) {
+        std::cerr << color::red << "Error: cannot write " << path << "\n" << color::reset;
+        return false;
+    }
+    return true;
+}
+
+static int cmd_serve(const std::vector<std::string>& args) {
+    fs::path socket = Server::default_socket();
+    for (std::size_t i = 0; i < args.size(); i++) {
+        if (args[i] == "--socket" && i + 1 < args.size()) {
+            socket = args[++i];
+        } else {
+            std::cerr << color::red << "Error: unknown serve option " << args[i] << "\n" << color::reset;
+            return 1;
+        }
+    }
+    if (socket.empty()) {
+        std::cerr << color::red << "Error: no socket path (AUTOIGNORE_SOCKET is empty)\n" << color::reset;
+        return 1;
+    }
+
+    Server server(socket, [](TemplateStore& store, const Detector& detector, std::vector<std::string> request) {
+        std::vector<char*> argv{const_cast<char*>("autoignore")};
+        for (auto& a : request) argv.push_back(a.data());
+        argv.push_back(nullptr);
+        CliOptions o;
+        if (int rc = parse_options(int(argv.size() - 1), argv.data(), o); rc >= 0) return rc;
+        // Needs the client's terminal, or its stdin.
+        if (o.interactive || o.watch || o.batch_list == "-") {
+            std::cerr << color::red << "Error: not supported by the daemon\n" << color::reset;
+            return 1;
+        }
+        return run_options(store, &detector, o);
+    });
+    return server.run();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && argv[1][0] != '-') {
+        int rc = run_command(argv[1], std::vector<std::string>(argv + 2, argv + argc));
+        if (rc >= 0) return rc;
+    }
+
+    CliOptions o;
+    if (int rc = parse_options(argc, argv, o); rc >= 0) return rc;
+
+    // Runs being measured stay in this process.
+    if (!o.stats_json.empty() || !o.trace.empty()) {
+        Stats stats;
+        int rc;
+        {
+            TemplateStore store;
+            rc = run_options(store, nullptr, o);
+        }
+        bool written = write_stats(stats, o.stats_json, false);
+        written = write_stats(stats, o.trace, true) && written;
+        return written ? rc : 1;
+    }
+
+    // Hand plain runs to a `serve` daemon when one is listening.
+    if (!o.interactive && !o.watch && o.batch_list.empty()) {
+        int rc = Server::forward(Server::default_socket(), std::vector<std::string>(argv + 1, argv + argc));
+        if (rc >= 0) return rc;
+    }
+
+    TemplateStore store;
+    return run_options(store, nullptr, o);
+}
@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""Generates the table of bundled templates compiled into autoignore.
+
+Usage:
+  embed_templates.py --list DIR          print DIR/*.gitignore, one per line
+  embed_templates.py -o OUT [FILES...]   write the C++ table for FILES
+  embed_templates.py -o OUT --no-content [FILES...]
+                                         write only the prune list for FILES
+"""
+
+import argparse
+import os
+import re
+import sys
+
+# Directory names the templates ignore that commonly hold sources, docs or
+# configuration in other projects. They are left out of the prune list so
+# detection still sees what is inside them.
+KEEP_DIRS = {
+    'Migrations', 'Package', 'Public', 'Resources', 'SOURCES', 'SPECS',
+    'Saved', 'Testing', 'META-INF', 'bin', 'build-aux', 'captures', 'certs',
+    'data', 'debug', 'doc', 'docs', 'env', 'gen', 'gradle', 'html',
+    'instance', 'latex', 'lib', 'lib64', 'local', 'm4', 'man', 'media',
+    'ndk', 'package', 'pkg', 'proguard', 'rtf', 'sdk', 'secrets', 'sessions',
+    'src', 'stage', 'storage', 'uploads', 'var', 'volumes', 'work', 'xml',
+}
+
+DIR_PATTERN = re.compile(rb'(?:\*\*/)?([^./!#*?\[\\\s][^/*?\[\\\s]*)/')
+
+
+def parse_header(lines):
+    # Mirrors TemplateStore::parse_header.
+    patterns = []
+    rules = []
+    for line in lines:
+        if not line:
+            break
+        if line.startswith(b'# @detect:'):
+            patterns.extend(line[10:].split())
+        elif line.startswith(b'# @content:'):
+            rule = line[11:].strip(b' \t\r')
+            if rule:
+                rules.append(rule)
+        elif line[:1] != b'#':
+            break
+    return patterns, rules
+
+
+def content_hash(data):
+    # Mirrors TemplateStore::content_hash: 64-bit FNV-1a.
+    h = 0xcbf29ce484222325
+    for b in data:
+        h = ((h ^ b) * 0x100000001b3) & 0xffffffffffffffff
+    return h
+
+
+def prune_dirs(contents):
+    # Literal `name/` rules: directories the templates ignore wherever they
+    # appear, such as node_modules/ or target/.
+    names = set()
+    for data in contents:
+        for line in data.split(b'\n'):
+            m = DIR_PATTERN.fullmatch(line.strip())
+            if m:
+                names.add(m.group(1))
+    return sorted(n for n in names if n.decode('latin-1') not in KEEP_DIRS)
+
+
+def literal(data):
+    out = []
+    for chunk in data.splitlines(keepends=True) or [b'']:
+        s = ''
+        for b in chunk:
+            c = chr(b)
+            if c == '"':
+                s += '\\"'
+            elif c == '\\':
+                s += '\\\\'
+            elif c == '\n':
+                s += '\\n'
+            elif c == '\t':
+                s += '\\t'
+            elif c == '?':
+                s += '\\?'  # avoid trigraphs
+            elif 32 <= b < 127:
+                s += c
+            else:
+                s += '\\%03o' % b
+        out.append('"%s"' % s)
+    return '\n        '.join(out)
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--list', metavar='DIR')
+    ap.add_argument('-o', '--output')
+    ap.add_argument('--no-content', action='store_true',
+                    help='leave the template table empty')
+    ap.add_argument('files', nargs='*')
+    args = ap.parse_args()
+
+    if args.list:
+        for name in sorted(os.listdir(args.list)):
+            if name.endswith('.gitignore'):
+                print(os.path.join(args.list, name))
+        return 0
+
+    entries = []
+    for path in args.files:
+        name = os.path.basename(path)[:-len('.gitignore')]
+        with open(path, 'rb') as f:
+            data = f.read()
+        entries.append((name, data) + parse_header(data.split(b'\n')))
+    entries.sort(key=lambda e: e[0].encode())
+    prune = prune_dirs(e[1] for e in entries)
+    if args.no_content:
+        entries = []
+
+    out = ['// Generated by tools/embed_templates.py; do not edit.',
+           '#include "EmbeddedTemplates.hpp"',
+           '',
+           'using namespace std::string_view_literals;',
+           '',
+           'namespace {',
+           '']
+    for i, (name, _, patterns, rules) in enumerate(entries):
+        if patterns:
+            items = ', '.join(literal(p) for p in patterns)
+            out.append('constexpr std::string_view detect_%d[] = {%s};' % (i, items))
+        if rules:
+            items = ', '.join(literal(r) for r in rules)
+            out.append('constexpr std::string_view content_%d[] = {%s};' % (i, items))
+    out += ['',
+            'constexpr std::string_view prune[] = {']
+    out += ['    %ssv,' % literal(name) for name in prune]
+    if not prune:
+        out.append('    {},')
+    out += ['};',
+            '',
+            'constexpr EmbeddedTemplate table[] = {']
+    for i, (name, data, patterns, rules) in enumerate(entries):
+        det = ('detect_%d, %d' % (i, len(patterns))) if patterns else 'nullptr, 0'
+        con = ('content_%d, %d' % (i, len(rules))) if rules else 'nullptr, 0'
+        out.append('    {%s,\n        %ssv,\n        %s, %s, 0x%016xULL},'
+                   % (literal(name.encode()), literal(data), det, con, content_hash(data)))
+    if not entries:
+        out.append('    {{}, {}, nullptr, 0, nullptr, 0, 0},')
+    out += ['};',
+            '',
+            '} // namespace',
+            '',
+            'std::span<const EmbeddedTemplate> embedded_templates() {',
+            '    return std::span<const EmbeddedTemplate>(table, %d);' % len(entries),
+            '}',
+            '',
+            'std::span<const std::string_view> default_prune_dirs() {',
+            '    return std::span<const std::string_view>(prune, %d);' % len(prune),
+            '}',
+            '']
+
+    with open(args.output, 'w') as f:
+        f.write('\n'.join(out))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())